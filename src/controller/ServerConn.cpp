@@ -106,7 +106,7 @@ void ServerConn::send(std::string msg)
     {
         msg.append(1, '\n');
     }
-    LOG(DEBUG) << "ServerConn::send " << msg;
+    LOG_RATE(DEBUG, 100) << "ServerConn::send " << msg;
     ioService_.post(boost::bind(&ServerConn::doSend, this, msg));
 }
 
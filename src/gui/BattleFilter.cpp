@@ -0,0 +1,86 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#include "BattleFilter.h"
+
+#include "model/Battle.h"
+
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <cctype>
+
+BattleFilterSettings::BattleFilterSettings():
+    minPlayers_(0),
+    maxPlayers_(0),
+    hideRunning_(false),
+    hideLocked_(false),
+    hidePassworded_(false)
+{
+}
+
+BattleFilter::BattleFilter():
+    game_(""),
+    map_(""),
+    engine_(""),
+    host_("")
+{
+}
+
+BattleFilter::BattleFilter(BattleFilterSettings const & settings):
+    settings_(settings),
+    game_(settings.game_),
+    map_(settings.map_),
+    engine_(settings.engine_),
+    host_(settings.host_)
+{
+}
+
+bool BattleFilter::passes(Battle const & battle) const
+{
+    // cheap checks first
+    int const players = battle.playerCount();
+    if (players < settings_.minPlayers_) return false;
+    if (settings_.maxPlayers_ > 0 && players > settings_.maxPlayers_) return false;
+    if (settings_.hideRunning_ && battle.running()) return false;
+    if (settings_.hideLocked_ && battle.locked()) return false;
+    if (settings_.hidePassworded_ && battle.passworded()) return false;
+
+    return game_.matches(battle.modName())
+        && map_.matches(battle.mapName())
+        && engine_.matches(battle.engineVersionLong())
+        && host_.matches(battle.founder());
+}
+
+BattleFilter::Patterns::Patterns(std::string const & text)
+{
+    std::vector<std::string> tokens;
+    boost::algorithm::split(tokens, text, boost::is_any_of(","));
+
+    for (auto & token : tokens)
+    {
+        boost::trim(token);
+        if (!token.empty()) // ignore empty patterns
+        {
+            boost::to_upper(token);
+            needles_.push_back(token);
+        }
+    }
+}
+
+bool BattleFilter::Patterns::matches(std::string const & text) const
+{
+    if (needles_.empty())
+    {
+        return true;
+    }
+
+    auto const equalI = [](char t, char n) { return std::toupper(static_cast<unsigned char>(t)) == n; };
+
+    for (auto const & needle : needles_)
+    {
+        if (std::search(text.begin(), text.end(), needle.begin(), needle.end(), equalI) != text.end())
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,60 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+class Battle;
+
+struct BattleFilterSettings
+{
+    // text criteria are comma separated case-insensitive substrings, empty matches all
+    std::string game_;
+    std::string map_;
+    std::string engine_;
+    std::string host_;
+    int minPlayers_;
+    int maxPlayers_; // 0 for no upper limit
+    bool hideRunning_;
+    bool hideLocked_;
+    bool hidePassworded_;
+
+    BattleFilterSettings();
+};
+
+// filter compiled from BattleFilterSettings, cheap to evaluate for every battle change
+class BattleFilter
+{
+public:
+    BattleFilter(); // passes all battles
+    explicit BattleFilter(BattleFilterSettings const & settings);
+
+    BattleFilterSettings const & settings() const;
+    bool passes(Battle const & battle) const;
+
+private:
+    // any of a set of case-insensitive substrings
+    class Patterns
+    {
+    public:
+        explicit Patterns(std::string const & text); // comma separated
+        bool matches(std::string const & text) const;
+
+    private:
+        std::vector<std::string> needles_; // upper case
+    };
+
+    BattleFilterSettings settings_;
+    Patterns game_;
+    Patterns map_;
+    Patterns engine_;
+    Patterns host_;
+};
+
+// inline methods
+
+inline BattleFilterSettings const & BattleFilter::settings() const
+{
+    return settings_;
+}
@@ -6,6 +6,7 @@
 
 #include <FL/Fl_Input.H>
 #include <FL/Fl_Int_Input.H>
+#include <FL/Fl_Check_Button.H>
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Return_Button.H>
 #include <FL/Fl.H>
@@ -15,20 +16,36 @@
 
 
 BattleFilterDialog::BattleFilterDialog():
-    Fl_Window(400, 400, "Battle filter")
+    Fl_Window(400, 480, "Battle filter")
 {
     set_modal();
 
     game_ = new Fl_Input(10, 30, 380, 30, "Game (e.g 'zero,nota')");
     game_->align(FL_ALIGN_TOP_LEFT);
 
-    players_ = new Fl_Int_Input(10, 100, 380, 30, "Minimum players");
-    players_->align(FL_ALIGN_TOP_LEFT);
+    map_ = new Fl_Input(10, 90, 380, 30, "Map");
+    map_->align(FL_ALIGN_TOP_LEFT);
 
-    box_ = new Fl_Box(10, 170, 380, 30);
+    engine_ = new Fl_Input(10, 150, 380, 30, "Engine");
+    engine_->align(FL_ALIGN_TOP_LEFT);
+
+    host_ = new Fl_Input(10, 210, 380, 30, "Host");
+    host_->align(FL_ALIGN_TOP_LEFT);
+
+    minPlayers_ = new Fl_Int_Input(10, 270, 185, 30, "Minimum players");
+    minPlayers_->align(FL_ALIGN_TOP_LEFT);
+
+    maxPlayers_ = new Fl_Int_Input(205, 270, 185, 30, "Maximum players (0=any)");
+    maxPlayers_->align(FL_ALIGN_TOP_LEFT);
+
+    hideRunning_ = new Fl_Check_Button(10, 310, 380, 30, "Hide running battles");
+    hideLocked_ = new Fl_Check_Button(10, 340, 380, 30, "Hide locked battles");
+    hidePassworded_ = new Fl_Check_Button(10, 370, 380, 30, "Hide passworded battles");
+
+    box_ = new Fl_Box(10, 400, 380, 30);
     box_->labelcolor(FL_RED);
 
-    Fl_Return_Button * btn = new Fl_Return_Button(280, 350, 110, 30, "Set filter");
+    Fl_Return_Button * btn = new Fl_Return_Button(280, 440, 110, 30, "Set filter");
     btn->callback(BattleFilterDialog::callback, this);
 
     end();
@@ -46,34 +63,61 @@ void BattleFilterDialog::callback(Fl_Widget*, void *data)
 
 void BattleFilterDialog::onFilterSet()
 {
-    int players = -1;
+    BattleFilterSettings settings;
+    settings.minPlayers_ = -1;
+    settings.maxPlayers_ = -1;
     try
     {
-        players = boost::lexical_cast<int>(players_->value());
+        settings.minPlayers_ = boost::lexical_cast<int>(minPlayers_->value());
+        settings.maxPlayers_ = boost::lexical_cast<int>(maxPlayers_->value());
     }
     catch (boost::bad_lexical_cast & e)
     {
         // check below will display error
     }
 
-    if (players < 0)
+    if (settings.minPlayers_ < 0 || settings.maxPlayers_ < 0)
     {
         box_->label("Players must be a non-negative number");
         Sound::beep();
         return;
     }
 
-    std::string gameFilter = game_->value();
-    boost::trim(gameFilter);
-    filterSetSignal_(gameFilter, players);
+    if (settings.maxPlayers_ > 0 && settings.maxPlayers_ < settings.minPlayers_)
+    {
+        box_->label("Maximum players is less than minimum players");
+        Sound::beep();
+        return;
+    }
+
+    settings.game_ = game_->value();
+    settings.map_ = map_->value();
+    settings.engine_ = engine_->value();
+    settings.host_ = host_->value();
+    boost::trim(settings.game_);
+    boost::trim(settings.map_);
+    boost::trim(settings.engine_);
+    boost::trim(settings.host_);
+
+    settings.hideRunning_ = hideRunning_->value() != 0;
+    settings.hideLocked_ = hideLocked_->value() != 0;
+    settings.hidePassworded_ = hidePassworded_->value() != 0;
+
+    filterSetSignal_(settings);
     box_->label(0);
     hide();
 }
 
-void BattleFilterDialog::show(std::string const & game, int players)
+void BattleFilterDialog::show(BattleFilterSettings const & settings)
 {
-    game_->value(game.c_str());
-    players_->value(boost::lexical_cast<std::string>(players).c_str());
+    game_->value(settings.game_.c_str());
+    map_->value(settings.map_.c_str());
+    engine_->value(settings.engine_.c_str());
+    host_->value(settings.host_.c_str());
+    minPlayers_->value(boost::lexical_cast<std::string>(settings.minPlayers_).c_str());
+    maxPlayers_->value(boost::lexical_cast<std::string>(settings.maxPlayers_).c_str());
+    hideRunning_->value(settings.hideRunning_ ? 1 : 0);
+    hideLocked_->value(settings.hideLocked_ ? 1 : 0);
+    hidePassworded_->value(settings.hidePassworded_ ? 1 : 0);
     Fl_Window::show();
 }
-
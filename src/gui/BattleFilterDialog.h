@@ -2,12 +2,15 @@
 
 #pragma once
 
+#include "BattleFilter.h"
+
 #include <FL/Fl_Window.H>
 #include <boost/signals2/signal.hpp>
 #include <string>
 
 class Fl_Input;
 class Fl_Int_Input;
+class Fl_Check_Button;
 class Fl_Box;
 
 class BattleFilterDialog: public Fl_Window
@@ -16,17 +19,24 @@ public:
     BattleFilterDialog();
     virtual ~BattleFilterDialog();
 
-    void show(std::string const & game, int players);
+    void show(BattleFilterSettings const & settings);
 
     // signals
     //
-    typedef boost::signals2::signal<void (std::string const & game, int players)> FilterSetSignal;
+    typedef boost::signals2::signal<void (BattleFilterSettings const & settings)> FilterSetSignal;
     boost::signals2::connection connectFilterSet(FilterSetSignal::slot_type subscriber)
     { return filterSetSignal_.connect(subscriber); }
 
 private:
     Fl_Input * game_;
-    Fl_Int_Input * players_;
+    Fl_Input * map_;
+    Fl_Input * engine_;
+    Fl_Input * host_;
+    Fl_Int_Input * minPlayers_;
+    Fl_Int_Input * maxPlayers_;
+    Fl_Check_Button * hideRunning_;
+    Fl_Check_Button * hideLocked_;
+    Fl_Check_Button * hidePassworded_;
     Fl_Box * box_;
     FilterSetSignal filterSetSignal_;
 
@@ -17,12 +17,18 @@
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
-#include <boost/algorithm/string.hpp>
 #include <sstream>
 #include <cassert>
 
 static char const * PrefBattleFilterGame = "BattleFilterGame";
+static char const * PrefBattleFilterMap = "BattleFilterMap";
+static char const * PrefBattleFilterEngine = "BattleFilterEngine";
+static char const * PrefBattleFilterHost = "BattleFilterHost";
 static char const * PrefBattleFilterPlayers = "BattleFilterPlayers";
+static char const * PrefBattleFilterMaxPlayers = "BattleFilterMaxPlayers";
+static char const * PrefBattleFilterHideRunning = "BattleFilterHideRunning";
+static char const * PrefBattleFilterHideLocked = "BattleFilterHideLocked";
+static char const * PrefBattleFilterHidePassworded = "BattleFilterHidePassworded";
 
 
 BattleList::BattleList(int x, int y, int w, int h, Model & model, Cache & cache): // TODO cache is only needed by BattleInfo
@@ -31,7 +37,7 @@ BattleList::BattleList(int x, int y, int w, int h, Model & model, Cache & cache)
 {
     int const h1 = h-128;
     battleList_ = new StringTable(x, y, w, h1, "BattleList",
-            { {"status",4}, {"title / host",15}, {"engine",4}, {"game",10}, {"map",15}, {"players",4} }, -5 /* sort on players by default */);
+            { {"status",4}, {"title / host",15}, {"engine",4}, {"game",10}, {"map",15}, {"players",4,true} }, -5 /* sort on players by default */);
 
     battleInfo_ = new BattleInfo(x, y+h1, w, h-h1, model_, cache);
 
@@ -54,34 +60,51 @@ BattleList::BattleList(int x, int y, int w, int h, Model & model, Cache & cache)
     battleList_->connectRowClicked( boost::bind(&BattleList::battleListRowClicked, this, _1, _2) );
     battleList_->connectRowDoubleClicked( boost::bind(&BattleList::battleListRowDoubleClicked, this, _1, _2) );
 
-    battleFilterDialog_->connectFilterSet( boost::bind(&BattleList::setFilter, this, _1, _2) );
+    battleFilterDialog_->connectFilterSet( boost::bind(&BattleList::setFilter, this, _1) );
 
     // read prefs
+    BattleFilterSettings settings;
     char str[65];
     prefs().get(PrefBattleFilterGame, str, "", 64);
-    filterGame_ = str;
-    prefs().get(PrefBattleFilterPlayers, filterPlayers_, 0);
+    settings.game_ = str;
+    prefs().get(PrefBattleFilterMap, str, "", 64);
+    settings.map_ = str;
+    prefs().get(PrefBattleFilterEngine, str, "", 64);
+    settings.engine_ = str;
+    prefs().get(PrefBattleFilterHost, str, "", 64);
+    settings.host_ = str;
+    prefs().get(PrefBattleFilterPlayers, settings.minPlayers_, 0);
+    prefs().get(PrefBattleFilterMaxPlayers, settings.maxPlayers_, 0);
+    int val;
+    prefs().get(PrefBattleFilterHideRunning, val, 0);
+    settings.hideRunning_ = val != 0;
+    prefs().get(PrefBattleFilterHideLocked, val, 0);
+    settings.hideLocked_ = val != 0;
+    prefs().get(PrefBattleFilterHidePassworded, val, 0);
+    settings.hidePassworded_ = val != 0;
+    filter_ = BattleFilter(settings);
 
 }
 
 BattleList::~BattleList()
 {
-    prefs().set(PrefBattleFilterGame, filterGame_.c_str());
-    prefs().set(PrefBattleFilterPlayers, filterPlayers_);
+    BattleFilterSettings const & settings = filter_.settings();
+    prefs().set(PrefBattleFilterGame, settings.game_.c_str());
+    prefs().set(PrefBattleFilterMap, settings.map_.c_str());
+    prefs().set(PrefBattleFilterEngine, settings.engine_.c_str());
+    prefs().set(PrefBattleFilterHost, settings.host_.c_str());
+    prefs().set(PrefBattleFilterPlayers, settings.minPlayers_);
+    prefs().set(PrefBattleFilterMaxPlayers, settings.maxPlayers_);
+    prefs().set(PrefBattleFilterHideRunning, settings.hideRunning_ ? 1 : 0);
+    prefs().set(PrefBattleFilterHideLocked, settings.hideLocked_ ? 1 : 0);
+    prefs().set(PrefBattleFilterHidePassworded, settings.hidePassworded_ ? 1 : 0);
 }
 
 void BattleList::loginResult(bool success, std::string const & info)
 {
     if (success)
     {
-        std::vector<Battle const *> battles = model_.getBattles();
-
-        for (auto b : battles)
-        {
-            assert(b);
-            battleOpened(*b);
-        }
-        battleList_->sort();
+        filterBattles();
     }
 }
 
@@ -97,29 +120,23 @@ void BattleList::battleOpened(const Battle & battle)
 
 void BattleList::battleChanged(const Battle & battle)
 {
+    std::string const id = boost::lexical_cast<std::string>(battle.id());
+    bool const shown = battleList_->rowExist(id);
+
     if (passesFilter(battle))
     {
-        StringTableRow row = makeRow(battle);
-        try
+        if (shown)
         {
-            battleList_->updateRow(row);
+            battleList_->updateRow(makeRow(battle));
         }
-        catch (std::runtime_error & e)
+        else
         {
-            // battle was not in list, add it
-            battleList_->addRow(row);
+            battleList_->addRow(makeRow(battle));
         }
     }
-    else
+    else if (shown)
     {
-        try
-        {
-            battleList_->removeRow(boost::lexical_cast<std::string>(battle.id()));
-        }
-        catch (std::runtime_error & e)
-        {
-            // battle was not in list, ignore
-        }
+        battleList_->removeRow(id);
     }
 }
 
@@ -127,13 +144,10 @@ void BattleList::battleChanged(const Battle & battle)
 
 void BattleList::battleClosed(const Battle & battle)
 {
-    try
-    {
-        battleList_->removeRow(boost::lexical_cast<std::string>(battle.id()));
-    }
-    catch (std::runtime_error & e)
+    std::string const id = boost::lexical_cast<std::string>(battle.id());
+    if (battleList_->rowExist(id))
     {
-        // battle was not in list, ignore
+        battleList_->removeRow(id);
     }
 }
 
@@ -145,6 +159,7 @@ void BattleList::userJoinedLeftBattle(User const & user, const Battle & battle)
 
 void BattleList::refresh()
 {
+    filterBattles();
     battleInfo_->refresh();
 }
 
@@ -155,13 +170,14 @@ void BattleList::battleListRowChanged(int rowIndex)
         StringTableRow const & row = battleList_->getRow(static_cast<std::size_t>(rowIndex));
 
         int const battleId = boost::lexical_cast<int>(row.id_);
-        try
+        Battle const * battle = model_.findBattle(battleId);
+        if (battle != 0)
         {
-            Battle const & battle = model_.getBattle(battleId);
-            battleInfo_->battle(battle);
-        } catch (std::exception const & e)
+            battleInfo_->battle(*battle);
+        }
+        else
         {
-            LOG(WARNING) << "exception in battleListRowChanged:" << e.what();
+            LOG(WARNING) << "battle not found in battleListRowChanged:" << battleId;
         }
     }
     else
@@ -254,57 +270,32 @@ void BattleList::connected(bool connected)
     }
 }
 
-void BattleList::setFilter(std::string const & game, int players)
+void BattleList::setFilter(BattleFilterSettings const & settings)
 {
-    filterGame_ = game;
-    filterPlayers_ = players;
-
-    battleList_->clear();
+    filter_ = BattleFilter(settings);
+    filterBattles();
+}
 
+void BattleList::filterBattles()
+{
+    std::vector<StringTableRow> rows;
     for (Battle const * b : model_.getBattles())
     {
+        assert(b);
         if (passesFilter(*b))
         {
-            battleList_->addRow(makeRow(*b));
+            rows.push_back(makeRow(*b));
         }
-
     }
+    battleList_->setRows(rows);
 }
 
 bool BattleList::passesFilter(Battle const & battle)
 {
-    if (battle.playerCount() < filterPlayers_) return false;
-
-    if (!filterGame_.empty())
-    {
-        std::vector<std::string> games;
-        boost::algorithm::split(games, filterGame_, boost::is_any_of(","));
-
-        int matches = 0;
-        for (auto& game : games)
-        {
-            boost::trim(game);
-
-            if (game.empty())
-            {
-                // ignore empty game filters
-                matches += 1;
-            }
-            else if ( !boost::algorithm::ifind_first(battle.modName(), game).empty() )
-            {
-                matches += 1;
-            }
-        }
-        if (matches == 0)
-        {
-            return false;
-        }
-    }
-
-    return true;
+    return filter_.passes(battle);
 }
 
 void BattleList::showFilterDialog()
 {
-    battleFilterDialog_->show(filterGame_, filterPlayers_);
+    battleFilterDialog_->show(filter_.settings());
 }
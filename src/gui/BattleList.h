@@ -3,6 +3,7 @@
 #pragma once
 
 #include "StringTable.h"
+#include "BattleFilter.h"
 
 #include <FL/Fl_Group.H>
 
@@ -30,8 +31,7 @@ private:
     Model & model_;
     StringTable * battleList_;
     BattleInfo * battleInfo_;
-    std::string filterGame_;
-    int filterPlayers_;
+    BattleFilter filter_;
     BattleFilterDialog * battleFilterDialog_;
 
     // model signal handlers
@@ -53,7 +53,8 @@ private:
     void joinBattle(Battle const & battle);
 
     bool passesFilter(Battle const & battle);
-    void setFilter(std::string const & game, int players);
+    void setFilter(BattleFilterSettings const & settings);
+    void filterBattles(); // re-apply filter to all battles
 
 };
 
@@ -125,7 +125,7 @@ BattleRoom::BattleRoom(int x, int y, int w, int h, Model & model, Cache & cache,
     int const playerH = topH - headerH;
 
     playerList_ = new StringTable(x, y, w - rightW, playerH, "PlayerList",
-            { {"status",4}, {"sync",3}, {"name",10}, {"side",4}, {"ally",3}, {"team",4}, {"rank",3}, {"color",3}, {"country",4} }, 4 /* sort on ally by default */);
+            { {"status",4}, {"sync",3}, {"name",10}, {"side",4}, {"ally",3}, {"team",4}, {"rank",3,true}, {"color",3}, {"country",4} }, 4 /* sort on ally by default */);
 
     top_->resizable(playerList_);
     top_->end();
@@ -993,15 +993,10 @@ void BattleRoom::onComplete(std::string const& text, std::size_t pos, std::strin
     for (int i=0; i<playerList_->rows(); ++i)
     {
         StringTableRow const & row = playerList_->getRow(static_cast<std::size_t>(i));
-        try
+        if (model_.findUser(row.data_[2])) // ignore bots
         {
-            User const & user = model_.getUser(row.data_[2]);
             userNames.push_back(row.data_[2]);
         }
-        catch (std::invalid_argument const & e)
-        {
-            // ignore bots
-        }
     }
 
     auto const match = findMatch(userNames, pairWordPos.first, ignore);
@@ -1015,40 +1010,14 @@ void BattleRoom::onComplete(std::string const& text, std::size_t pos, std::strin
 
 void BattleRoom::updateBalance()
 {
-    Balance balance;
-
-    for (int i=0; i<playerList_->rows(); ++i)
+    if (battleId_ != -1)
     {
-        StringTableRow const& row = playerList_->getRow(static_cast<std::size_t>(i));
-        std::string str = row.data_[4]; // copy since we may remove initial space below
-        if (str.empty())
-        {
-            LOG(WARNING)<< "unexpected empty ally team string";
-            continue;
-        }
-        if (str[0] != 's') // only non-specs
+        Battle const & battle = model_.getBattle(battleId_);
+        if (balance_ != battle.allyTeamCounts())
         {
-            if (str[0] == ' ')
-            {
-                str.erase(0, 1);
-            }
-
-            try
-            {
-                int allyTeam = boost::lexical_cast<int>(str);
-                balance[allyTeam] += 1;
-            }
-            catch (boost::bad_lexical_cast const& ex)
-            {
-                LOG(WARNING)<< "unexpected allyTeam: " << str;
-            }
+            balance_ = battle.allyTeamCounts();
+            setHeaderText(battle);
         }
     }
-
-    if (battleId_ != -1 && balance_ != balance)
-    {
-        balance_ = balance;
-        setHeaderText(model_.getBattle(battleId_));
-    }
 }
 
@@ -87,8 +87,8 @@ private:
     std::string currentMapImage_; // optimization, indicates what map image is currently shown to avoid setting the same image
     std::vector<std::string> sideNames_;
 
-    typedef std::map<int,int> Balance;
-    Balance balance_; // number of non-spec players in unique ally teams
+    typedef Battle::AllyTeamCounts Balance;
+    Balance balance_; // number of non-spec players in unique ally teams, copy of battle counts to detect changes
     void updateBalance();
 
     StringTable * playerList_;
@@ -4,19 +4,24 @@
 
 #include "log/Log.h"
 #include "model/Model.h"
+#include "model/PixelConvert.h"
 #include "FlobbyDirs.h"
+#include "ImageScale.h"
 
-#include <Magick++.h>
-#include <FL/Fl_Shared_Image.H>
+#include <FL/Fl_Image.H>
 
 #include <sstream> // ostringstream
 #include <fstream>
 #include <boost/filesystem.hpp>
+#include <set>
+#include <cstring>
 #include <cassert>
 
 Cache::Cache(Model & model):
     model_(model)
 {
+    mapInfoIndex_.reset(new MapInfoIndex(mapDir() + "mapinfo.bin"));
+    atlas_.reset(new ThumbnailAtlas(mapDir() + "thumbnails.bin"));
 }
 
 Cache::~Cache()
@@ -33,19 +38,26 @@ std::string Cache::mapDir()
     return basePath;
 }
 
-std::string Cache::mapPath(std::string const& mapName, std::string const& suffix)
+std::string Cache::mapKey(std::string const& mapName, std::string const& suffix)
 {
-    std::string path;
+    std::string key;
 
     unsigned int const chksum = model_.getMapChecksum(mapName);
     if (chksum != 0)
     {
         std::ostringstream oss;
-        oss << mapDir() << mapName << "_" << chksum << "_" << suffix;
-        path = oss.str();
+        oss << mapName << "_" << chksum << "_" << suffix;
+        key = oss.str();
     }
 
-    return path;
+    return key;
+}
+
+std::string Cache::mapPath(std::string const& mapName, std::string const& suffix)
+{
+    std::string const key = mapKey(mapName, suffix);
+
+    return key.empty() ? key : mapDir() + key;
 }
 
 std::string Cache::pathMapInfo(std::string const& mapName)
@@ -53,19 +65,19 @@ std::string Cache::pathMapInfo(std::string const& mapName)
     return mapPath(mapName, "info.bin");
 }
 
-std::string Cache::pathMapImage(std::string const& mapName)
+std::string Cache::keyMapImage(std::string const& mapName)
 {
-    return mapPath(mapName, "minimap_128.png");
+    return mapKey(mapName, "minimap_128");
 }
 
-std::string Cache::pathMetalImage(std::string const& mapName)
+std::string Cache::keyMetalImage(std::string const& mapName)
 {
-    return mapPath(mapName, "metal_128.png");
+    return mapKey(mapName, "metal_128");
 }
 
-std::string Cache::pathHeightImage(std::string const& mapName)
+std::string Cache::keyHeightImage(std::string const& mapName)
 {
-    return mapPath(mapName, "height_128.png");
+    return mapKey(mapName, "height_128");
 }
 
 std::string Cache::mapInfoKey(std::string const& mapName)
@@ -86,141 +98,171 @@ std::string Cache::mapInfoKey(std::string const& mapName)
 
 bool Cache::hasMapInfo(std::string const& mapName)
 {
-    std::string const key = mapInfoKey(mapName);
-    auto it = mapInfos_.find(key);
-    if (it != mapInfos_.end())
-    {
-        // loaded into memory
-        return true;
-    }
-
-    std::string const path = pathMapInfo(mapName);
-
-    return !path.empty() && boost::filesystem::exists(path);
+    return mapInfoIndex_->find(mapInfoKey(mapName)) != 0;
 }
 
 bool Cache::hasMapImage(std::string const & mapName)
 {
-    std::string const path = pathMapImage(mapName);
+    std::string const key = keyMapImage(mapName);
 
-    return !path.empty() && (Fl_Shared_Image::find(path.c_str()) || boost::filesystem::exists(path));
+    return !key.empty() && atlas_->has(key);
 }
 
 bool Cache::hasMetalImage(std::string const & mapName)
 {
-    std::string const path = pathMetalImage(mapName);
+    std::string const key = keyMetalImage(mapName);
 
-    return !path.empty() && (Fl_Shared_Image::find(path.c_str()) || boost::filesystem::exists(path));
+    return !key.empty() && atlas_->has(key);
 }
 
 bool Cache::hasHeightImage(std::string const & mapName)
 {
-    std::string const path = pathHeightImage(mapName);
+    std::string const key = keyHeightImage(mapName);
 
-    return !path.empty() && (Fl_Shared_Image::find(path.c_str()) || boost::filesystem::exists(path));
+    return !key.empty() && atlas_->has(key);
 }
 
-Fl_Shared_Image * Cache::getMapImage(std::string const & mapName)
+Fl_Image * Cache::getMapImage(std::string const & mapName)
 {
-    std::string const path = pathMapImage(mapName);
-    if (path.empty()) return 0;
-
-    Fl_Shared_Image * image = Fl_Shared_Image::get(path.c_str());
+    std::string const key = keyMapImage(mapName);
+    if (key.empty()) return 0;
 
+    Fl_Image * image = getImage(key);
     if (image == 0)
     {
-        // get 1024x1024 since higher mip levels can result in broken image, e.g. TinySkirmish
-        int const mipLevel = 0;
-        int const imageSize = 1024 >> mipLevel;
-
-        auto imageData = model_.getMapImage(mapName, mipLevel);
-        if (imageData)
+        ImageFile imageFile;
+        if (extractMapImage(mapName, imageFile))
         {
-            // get real dimensions (minimap is always a square)
-            int w,h;
-            model_.getMapSize(mapName, w, h);
-
-            createImageFile(imageData.get(), imageSize, imageSize, 3, path, static_cast<double>(w)/h);
-
-            image = Fl_Shared_Image::get(path.c_str());
-            if (image == 0)
-            {
-                throw std::runtime_error("Fl_Shared_Image::get failed:" + path);
-            }
+            writeImageFile(imageFile);
+            image = getImage(key);
         }
     }
     return image;
 }
 
-Fl_Shared_Image * Cache::getMetalImage(std::string const & mapName)
+Fl_Image * Cache::getMetalImage(std::string const & mapName)
 {
-    std::string const path = pathMetalImage(mapName);
-    if (path.empty()) return 0;
-
-    Fl_Shared_Image * image = Fl_Shared_Image::get(path.c_str());
+    std::string const key = keyMetalImage(mapName);
+    if (key.empty()) return 0;
 
+    Fl_Image * image = getImage(key);
     if (image == 0)
     {
-        int w, h;
-        auto imageData = model_.getMetalMap(mapName, w, h);
-        if (imageData)
+        ImageFile imageFile;
+        if (extractMetalImage(mapName, imageFile))
         {
-            // create RGB data to get a green metal map
-            std::unique_ptr<uint8_t[]> rgb(new uint8_t[3*w*h]);
-            for (int i=0; i<w*h; ++i)
-            {
-                rgb[i*3+0] = 0;
-                rgb[i*3+1] = imageData[i];
-                rgb[i*3+2] = 0;
-            }
-
-            createImageFile(rgb.get(), w, h, 3, path);
-
-            image = Fl_Shared_Image::get(path.c_str());
-            if (image == 0)
-            {
-                throw std::runtime_error("Fl_Shared_Image::get failed:" + path);
-            }
+            writeImageFile(imageFile);
+            image = getImage(key);
         }
     }
     return image;
 }
 
-Fl_Shared_Image * Cache::getHeightImage(std::string const & mapName)
+Fl_Image * Cache::getHeightImage(std::string const & mapName)
 {
-    std::string const path = pathHeightImage(mapName);
-    if (path.empty()) return 0;
-
-    Fl_Shared_Image * image = Fl_Shared_Image::get(path.c_str());
+    std::string const key = keyHeightImage(mapName);
+    if (key.empty()) return 0;
 
+    Fl_Image * image = getImage(key);
     if (image == 0)
     {
-        int w, h;
-        auto imageData = model_.getHeightMap(mapName, w, h);
-        if (imageData)
+        ImageFile imageFile;
+        if (extractHeightImage(mapName, imageFile))
         {
-            createImageFile(imageData.get(), w, h, 1, path);
-
-            image = Fl_Shared_Image::get(path.c_str());
-            if (image == 0)
-            {
-                throw std::runtime_error("Fl_Shared_Image::get failed:" + path);
-            }
+            writeImageFile(imageFile);
+            image = getImage(key);
         }
     }
     return image;
 }
 
-void Cache::createImageFile(uint8_t const * data, int w, int h, int d, std::string const & path, double r /* w/h */)
+Fl_Image * Cache::getImage(std::string const & key)
 {
-    assert(w > 0 && h > 0 && (d == 1 || d == 3) && r > 0);
+    auto it = images_.find(key);
+    if (it != images_.end())
+    {
+        return it->second.get();
+    }
+
+    ThumbnailAtlas::Image thumbnail;
+    if (!atlas_->get(key, thumbnail)) return 0;
+
+    // not copied, the pixels stay in the mapped atlas file
+    Fl_RGB_Image * image = new Fl_RGB_Image(thumbnail.data_, thumbnail.w_, thumbnail.h_, thumbnail.d_);
+    images_[key].reset(image);
+    return image;
+}
 
-    // create image, we will resize it below
-    Magick::Image image;
-    image.read(w, h, d == 1 ? "I" : "RGB", Magick::CharPixel, data);
-    image.depth(8);
+bool Cache::extractMapImage(std::string const & mapName, ImageFile & imageFile)
+{
+    imageFile.key_ = keyMapImage(mapName);
+    if (imageFile.key_.empty()) return false;
+
+    // get 1024x1024 since higher mip levels can result in broken image, e.g. TinySkirmish
+    int const mipLevel = 0;
+    int const imageSize = 1024 >> mipLevel;
+
+    imageFile.data_ = model_.getMapImage(mapName, mipLevel);
+    if (!imageFile.data_) return false;
+
+    // get real dimensions (minimap is always a square)
+    int w,h;
+    model_.getMapSize(mapName, w, h);
+
+    imageFile.w_ = imageSize;
+    imageFile.h_ = imageSize;
+    imageFile.d_ = 3;
+    imageFile.r_ = static_cast<double>(w)/h;
+    imageFile.filter_ = ImageFilterLanczos;
+    return true;
+}
 
-    double const r2 = static_cast<double>(w)/h * r;
+bool Cache::extractMetalImage(std::string const & mapName, ImageFile & imageFile)
+{
+    imageFile.key_ = keyMetalImage(mapName);
+    if (imageFile.key_.empty()) return false;
+
+    int w, h;
+    auto imageData = model_.getMetalMap(mapName, w, h);
+    if (!imageData) return false;
+
+    // create RGB data to get a green metal map
+    imageFile.data_.reset(new uint8_t[3*w*h]);
+    greyToRgb888(imageData.get(), imageFile.data_.get(), w*h, 0, 0xff, 0);
+
+    imageFile.w_ = w;
+    imageFile.h_ = h;
+    imageFile.d_ = 3;
+    imageFile.r_ = 1;
+    imageFile.filter_ = ImageFilterBox;
+    return true;
+}
+
+bool Cache::extractHeightImage(std::string const & mapName, ImageFile & imageFile)
+{
+    imageFile.key_ = keyHeightImage(mapName);
+    if (imageFile.key_.empty()) return false;
+
+    int w, h;
+    imageFile.data_ = model_.getHeightMap(mapName, w, h);
+    if (!imageFile.data_) return false;
+
+    imageFile.w_ = w;
+    imageFile.h_ = h;
+    imageFile.d_ = 1;
+    imageFile.r_ = 1;
+    imageFile.filter_ = ImageFilterBox;
+    return true;
+}
+
+void Cache::writeImageFile(ImageFile const & imageFile)
+{
+    int const w = imageFile.w_;
+    int const h = imageFile.h_;
+    int const d = imageFile.d_;
+    assert(w > 0 && h > 0 && (d == 1 || d == 3) && imageFile.r_ > 0);
+
+    double const r2 = static_cast<double>(w)/h * imageFile.r_;
 
     int const maxSize = 128;
     int w2 = maxSize;
@@ -236,47 +278,97 @@ void Cache::createImageFile(uint8_t const * data, int w, int h, int d, std::stri
     }
     assert(w2 > 0 && h2 > 0);
 
-    // resize and write
-    Magick::Geometry geom(w2, h2);
-    geom.aspect(true);
-    image.resize(geom);
-    image.write(path);
+    std::unique_ptr<uint8_t[]> scaled(new uint8_t[w2*h2*d]);
+    scaleImage(imageFile.data_.get(), w, h, scaled.get(), w2, h2, d, imageFile.filter_);
+
+    atlas_->add(imageFile.key_, scaled.get(), w2, h2, d);
+}
+
+void Cache::removeLegacyImageFiles()
+{
+    // "<mapname>_<chksum>_<suffix>.png" written by older versions, the thumbnails are in the atlas now
+    static char const * const suffixes[] = { "_minimap_128.png", "_metal_128.png", "_height_128.png" };
+
+    boost::system::error_code ec;
+    int removed = 0;
+    for (boost::filesystem::directory_iterator de(mapDir(), ec), end; !ec && de != end; de.increment(ec))
+    {
+        std::string const name = de->path().filename().string();
+        for (char const * suffix : suffixes)
+        {
+            std::size_t const size = std::strlen(suffix);
+            if (name.size() > size && name.compare(name.size() - size, size, suffix) == 0)
+            {
+                boost::system::error_code removeEc;
+                if (boost::filesystem::remove(de->path(), removeEc)) ++removed;
+                break;
+            }
+        }
+    }
+    if (removed > 0)
+    {
+        LOG(INFO) << "removed " << removed << " image files of older versions from " << mapDir();
+    }
+}
+
+void Cache::removeUnusedImages()
+{
+    removeLegacyImageFiles();
+
+    std::set<std::string> keys;
+    for (auto const & mapName : model_.getMaps())
+    {
+        for (auto const & key : { keyMapImage(mapName), keyMetalImage(mapName), keyHeightImage(mapName) })
+        {
+            if (!key.empty()) keys.insert(key);
+        }
+    }
+    if (keys.empty()) return; // maps not known, e.g. unitsync not loaded
+
+    try
+    {
+        for (auto const & key : atlas_->keys())
+        {
+            if (keys.count(key) == 0)
+            {
+                atlas_->remove(key);
+            }
+        }
+    }
+    catch (std::exception const & e)
+    {
+        LOG(WARNING) << "failed to remove unused thumbnails: " << e.what();
+    }
 }
 
 MapInfo const & Cache::getMapInfo(std::string const & mapName)
 {
     std::string const key = mapInfoKey(mapName);
 
-    auto it = mapInfos_.find(key);
-    if (it != mapInfos_.end())
+    MapInfo const * cached = mapInfoIndex_->find(key);
+    if (cached != 0)
     {
-        // loaded into memory
-        return it->second;
+        return *cached;
     }
-    else
-    {
-        std::string const path = pathMapInfo(mapName);
 
-        std::ifstream ifs(path);
-        if (ifs.good())
+    // take over the map info file of older versions
+    std::string const path = pathMapInfo(mapName);
+    std::ifstream ifs(path);
+    if (ifs.good())
+    {
+        try
         {
-            // map info file found
             MapInfo mapInfo;
             ifs >> mapInfo;
-            return mapInfos_[key] = mapInfo;
+            ifs.close();
+            boost::filesystem::remove(path);
+            return mapInfoIndex_->add(key, mapInfo);
         }
-        else
+        catch (std::exception const & e)
         {
-            // create map info file
-            MapInfo const mapInfo = model_.getMapInfo(mapName);
-            std::ofstream ofs(path);
-            if (!ofs.good())
-            {
-                LOG(WARNING) << "failed to open mapInfo file for writing:" << path;
-                throw std::runtime_error("failed to open mapInfo file for writing: " + path);
-            }
-            ofs << mapInfo;
-            return mapInfos_[key] = mapInfo;
+            LOG(WARNING) << "ignoring " << path << ": " << e.what();
         }
     }
+
+    return mapInfoIndex_->add(key, model_.getMapInfo(mapName));
 }
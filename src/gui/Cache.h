@@ -3,12 +3,18 @@
 #pragma once
 
 #include "model/MapInfo.h"
+#include "ImageScale.h"
+#include "ThumbnailAtlas.h"
+#include "MapInfoIndex.h"
 
 #include <map>
+#include <memory>
 #include <string>
+#include <cstdint>
 
 class Model;
-class Fl_Shared_Image;
+class Fl_Image;
+class Fl_RGB_Image;
 
 class Cache
 {
@@ -23,22 +29,48 @@ public:
     bool hasHeightImage(std::string const& mapName);
 
     MapInfo const&   getMapInfo(std::string const& mapName);
-    Fl_Shared_Image* getMapImage(std::string const& mapName); // returns 0 if map not found
-    Fl_Shared_Image* getMetalImage(std::string const& mapName);
-    Fl_Shared_Image* getHeightImage(std::string const& mapName);
+    Fl_Image* getMapImage(std::string const& mapName); // returns 0 if map not found
+    Fl_Image* getMetalImage(std::string const& mapName);
+    Fl_Image* getHeightImage(std::string const& mapName);
+
+    // image cache creation in two steps for scaling on other threads, extract* use unitsync
+    // and return false if the map is not found, writeImageFile adds the thumbnail to the atlas
+    // and is thread safe
+    struct ImageFile
+    {
+        std::unique_ptr<uint8_t[]> data_;
+        int w_;
+        int h_;
+        int d_;
+        double r_; // w/h
+        ImageFilter filter_;
+        std::string key_;
+    };
+    bool extractMapImage(std::string const& mapName, ImageFile & imageFile);
+    bool extractMetalImage(std::string const& mapName, ImageFile & imageFile);
+    bool extractHeightImage(std::string const& mapName, ImageFile & imageFile);
+    void writeImageFile(ImageFile const& imageFile);
+
+    // removes the thumbnails of maps that are not installed anymore or have changed and the
+    // image files of older versions, to be called when no images are generated
+    void removeUnusedImages();
 
 private:
     Model & model_;
-    std::map<std::string, MapInfo> mapInfos_;
+    std::unique_ptr<MapInfoIndex> mapInfoIndex_; // map infos of all maps in one file
+    std::unique_ptr<ThumbnailAtlas> atlas_; // thumbnails of all maps in one file
+    std::map<std::string, std::unique_ptr<Fl_RGB_Image>> images_; // pixels are in atlas_
 
     std::string mapDir();
     std::string mapInfoKey(std::string const& mapName); // returns "<mapname>_<chksum>", throws if map not found
 
-    std::string pathMapInfo(std::string const& mapName);
-    std::string pathMapImage(std::string const& mapName);
-    std::string pathMetalImage(std::string const& mapName);
-    std::string pathHeightImage(std::string const& mapName);
+    std::string pathMapInfo(std::string const& mapName); // written by older versions
+    std::string keyMapImage(std::string const& mapName);
+    std::string keyMetalImage(std::string const& mapName);
+    std::string keyHeightImage(std::string const& mapName);
+    std::string mapKey(std::string const& mapName, std::string const& suffix); // returns "<mapname>_<chksum>_<suffix>" or empty string if map do not exist
     std::string mapPath(std::string const& mapName, std::string const& suffix); // returns empty string if map do not exist
 
-    void createImageFile(uint8_t const* data, int w, int h, int d, std::string const& path, double r = 1 /* w/h */);
+    Fl_Image* getImage(std::string const& key); // returns 0 if not in the atlas
+    void removeLegacyImageFiles();
 };
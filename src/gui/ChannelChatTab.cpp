@@ -54,13 +54,13 @@ ChannelChatTab::ChannelChatTab(int x, int y, int w, int h, std::string const & c
     chatSettingsDialog_.connectChatSettingsChanged( boost::bind(&ChannelChatTab::initChatSettings, this) );
     initChatSettings();
 
-    // model signals
-    model_.connectChannelTopicSignal( boost::bind(&ChannelChatTab::topic, this, _1, _2, _3, _4) );
-    model_.connectChannelMessageSignal( boost::bind(&ChannelChatTab::message, this, _1, _2) );
-    model_.connectChannelClients( boost::bind(&ChannelChatTab::clients, this, _1, _2) );
-    model_.connectUserJoinedChannel( boost::bind(&ChannelChatTab::userJoined, this, _1, _2) );
-    model_.connectUserLeftChannel( boost::bind(&ChannelChatTab::userLeft, this, _1, _2, _3) );
-    model_.connectSaidChannel( boost::bind(&ChannelChatTab::said, this, _1, _2, _3) );
+    // model signals for this channel
+    model_.connectChannelTopicSignal( channelName_, boost::bind(&ChannelChatTab::topic, this, _1, _2, _3, _4) );
+    model_.connectChannelMessageSignal( channelName_, boost::bind(&ChannelChatTab::message, this, _1, _2) );
+    model_.connectChannelClients( channelName_, boost::bind(&ChannelChatTab::clients, this, _1, _2) );
+    model_.connectUserJoinedChannel( channelName_, boost::bind(&ChannelChatTab::userJoined, this, _1, _2) );
+    model_.connectUserLeftChannel( channelName_, boost::bind(&ChannelChatTab::userLeft, this, _1, _2, _3) );
+    model_.connectSaidChannel( channelName_, boost::bind(&ChannelChatTab::said, this, _1, _2, _3) );
 }
 
 ChannelChatTab::~ChannelChatTab()
@@ -132,18 +132,7 @@ void ChannelChatTab::clients(std::string const & channelName, std::vector<std::s
 {
     if (channelName == channelName_)
     {
-        for (std::string const & userName : clients)
-        {
-            // catch non-existing user exception here (uberserver bug) to not skip the rest of users in channel
-            try
-            {
-                userList_->add(userName);
-            }
-            catch (std::invalid_argument const& ex)
-            {
-                LOG(WARNING)<< ex.what();
-            }
-        }
+        userList_->add(clients);
     }
 }
 
@@ -0,0 +1,57 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#include "FrameScheduler.h"
+
+#include <FL/Fl.H>
+#include <algorithm>
+
+int const FrameScheduler::MinFramesPerSecond;
+int const FrameScheduler::MaxFramesPerSecond;
+FrameScheduler::Pending FrameScheduler::pending_;
+FrameScheduler::Pending FrameScheduler::running_;
+bool FrameScheduler::scheduled_ = false;
+int FrameScheduler::framesPerSecond_ = FrameScheduler::MaxFramesPerSecond;
+
+void FrameScheduler::update(Fl_Widget * widget, Update const & update)
+{
+    pending_[widget] = update;
+
+    if (!scheduled_)
+    {
+        Fl::add_timeout(1.0/framesPerSecond_, FrameScheduler::onFrame);
+        scheduled_ = true;
+    }
+}
+
+void FrameScheduler::cancel(Fl_Widget * widget)
+{
+    pending_.erase(widget);
+    running_.erase(widget);
+}
+
+void FrameScheduler::framesPerSecond(int fps)
+{
+    framesPerSecond_ = std::max(MinFramesPerSecond, std::min(fps, MaxFramesPerSecond));
+}
+
+int FrameScheduler::framesPerSecond()
+{
+    return framesPerSecond_;
+}
+
+void FrameScheduler::onFrame(void*)
+{
+    scheduled_ = false;
+
+    // updates scheduled by updates go to the next frame
+    running_.swap(pending_);
+
+    // take each update out before running it since it may cancel (destroy) other widgets
+    while (!running_.empty())
+    {
+        Pending::iterator it = running_.begin();
+        Update const update = it->second;
+        running_.erase(it);
+        update();
+    }
+}
@@ -0,0 +1,34 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+
+class Fl_Widget;
+
+// Defers widget updates to a single pass per display frame so high message rates
+// do not turn into high redraw rates. Only use from the FLTK thread.
+class FrameScheduler
+{
+public:
+    typedef std::function<void ()> Update;
+
+    static void update(Fl_Widget * widget, Update const & update); // run update in next frame, replaces pending update of widget
+    static void cancel(Fl_Widget * widget); // drop pending update, call from widget destructor
+
+    static void framesPerSecond(int fps); // clamped to [MinFramesPerSecond,MaxFramesPerSecond]
+    static int framesPerSecond();
+
+    static int const MinFramesPerSecond = 30;
+    static int const MaxFramesPerSecond = 60;
+
+private:
+    typedef std::unordered_map<Fl_Widget*, Update> Pending;
+    static Pending pending_;
+    static Pending running_; // updates of current frame
+    static bool scheduled_;
+    static int framesPerSecond_;
+
+    static void onFrame(void*);
+};
@@ -0,0 +1,296 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#include "ImageScale.h"
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cassert>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define IMAGE_SCALE_AVX2
+#endif
+
+// The image is scaled vertically into rows of 16 bit values with 6 fractional bits, then
+// horizontally into the destination. The vertical pass reads every source pixel and is done
+// with SIMD when available. Weights are 16 bit with 14 fractional bits and all arithmetic is
+// integer, so the SIMD paths give the same result as the scalar path.
+
+namespace
+{
+    int const WeightBits = 14;
+    int const RowBits = 6; // fractional bits of the horizontally scaled rows
+    double const LanczosRadius = 3;
+
+    // contributing source pixels for each destination pixel along one axis
+    struct Axis
+    {
+        int taps_;
+        std::vector<int> start_; // first source pixel, start_ + taps_ <= source size
+        std::vector<int16_t> weights_; // taps_ weights per destination pixel
+    };
+
+    double sinc(double x)
+    {
+        if (x == 0) return 1;
+        x *= M_PI;
+        return std::sin(x)/x;
+    }
+
+    double lanczos(double x)
+    {
+        return std::abs(x) < LanczosRadius ? sinc(x)*sinc(x/LanczosRadius) : 0;
+    }
+
+    Axis makeAxis(int sn, int dn, ImageFilter filter)
+    {
+        double const scale = static_cast<double>(sn)/dn;
+        double const support = filter == ImageFilterBox ? 0.5*scale : LanczosRadius*std::max(scale, 1.0);
+
+        std::vector<std::vector<double>> weights(dn);
+        std::vector<int> first(dn);
+        int taps = 1;
+
+        for (int i = 0; i < dn; ++i)
+        {
+            double const center = (i + 0.5)*scale;
+            int const j0 = std::max(static_cast<int>(std::floor(center - support)), 0);
+            int const j1 = std::min(static_cast<int>(std::ceil(center + support)), sn);
+
+            std::vector<double> & w = weights[i];
+            for (int j = j0; j < j1; ++j)
+            {
+                if (filter == ImageFilterBox)
+                {
+                    // part of source pixel j covered by destination pixel i
+                    w.push_back(std::max(std::min(j + 1.0, center + support) - std::max<double>(j, center - support), 0.0));
+                }
+                else
+                {
+                    w.push_back(lanczos((j + 0.5 - center)/std::max(scale, 1.0)));
+                }
+            }
+            if (w.empty())
+            {
+                w.push_back(1);
+            }
+            first[i] = std::min(j0, sn - 1);
+            taps = std::max(taps, static_cast<int>(w.size()));
+        }
+
+        Axis axis;
+        axis.taps_ = taps;
+        axis.start_.resize(dn);
+        axis.weights_.assign(dn*taps, 0);
+
+        for (int i = 0; i < dn; ++i)
+        {
+            std::vector<double> const & w = weights[i];
+
+            // move start back at the end so all taps are inside the source
+            int const start = std::max(std::min(first[i], sn - taps), 0);
+            int const offset = first[i] - start;
+            axis.start_[i] = start;
+
+            double sum = 0;
+            for (double v : w) sum += v;
+
+            // quantize and put the rounding error on the largest weight
+            int16_t * q = &axis.weights_[i*taps + offset];
+            int qsum = 0;
+            int largest = 0;
+            for (int k = 0; k < static_cast<int>(w.size()); ++k)
+            {
+                q[k] = static_cast<int16_t>(std::lround(w[k]/sum*(1 << WeightBits)));
+                qsum += q[k];
+                if (q[k] > q[largest]) largest = k;
+            }
+            q[largest] += (1 << WeightBits) - qsum;
+        }
+
+        return axis;
+    }
+
+    int const RowShift = WeightBits - RowBits;
+    int const FinalBits = WeightBits + RowBits;
+
+    // two weights as one 32 bit word for madd, a in the low half, built unsigned since b can be negative
+    int32_t weightPair(int16_t a, int16_t b)
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint16_t>(a)) |
+                                    static_cast<uint32_t>(static_cast<uint16_t>(b)) << 16);
+    }
+
+    // rows[k] is the k-th contributing source row, n values per row
+    void verticalScalar(uint8_t const* const* rows, int16_t const* w, int taps, int16_t* dst, int begin, int n)
+    {
+        for (int i = begin; i < n; ++i)
+        {
+            int sum = 0;
+            for (int k = 0; k < taps; ++k)
+            {
+                sum += w[k]*rows[k][i];
+            }
+            sum = (sum + (1 << (RowShift - 1))) >> RowShift;
+            dst[i] = static_cast<int16_t>(std::max(std::min(sum, 32767), -32768)); // like packs
+        }
+    }
+
+#if defined(__SSE2__)
+    void verticalSse2(uint8_t const* const* rows, int16_t const* w, int taps, int16_t* dst, int n)
+    {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const round = _mm_set1_epi32(1 << (RowShift - 1));
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i lo = zero;
+            __m128i hi = zero;
+            for (int k = 0; k < taps; k += 2)
+            {
+                // two rows at a time, madd gives w[k]*a + w[k+1]*b
+                bool const pair = k + 1 < taps;
+                __m128i const a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(rows[k] + i)), zero);
+                __m128i const b = pair ? _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(rows[k+1] + i)), zero) : zero;
+                int16_t const wb = pair ? w[k+1] : 0;
+                __m128i const wv = _mm_set1_epi32(weightPair(w[k], wb));
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wv));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wv));
+            }
+            lo = _mm_srai_epi32(_mm_add_epi32(lo, round), RowShift);
+            hi = _mm_srai_epi32(_mm_add_epi32(hi, round), RowShift);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+        }
+        verticalScalar(rows, w, taps, dst, i, n);
+    }
+#endif
+
+#if defined(IMAGE_SCALE_AVX2)
+    __attribute__((target("avx2")))
+    void verticalAvx2(uint8_t const* const* rows, int16_t const* w, int taps, int16_t* dst, int n)
+    {
+        __m256i const zero = _mm256_setzero_si256();
+        __m256i const round = _mm256_set1_epi32(1 << (RowShift - 1));
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256i lo = zero;
+            __m256i hi = zero;
+            for (int k = 0; k < taps; k += 2)
+            {
+                bool const pair = k + 1 < taps;
+                __m256i const a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(rows[k] + i)));
+                __m256i const b = pair ? _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(rows[k+1] + i))) : zero;
+                int16_t const wb = pair ? w[k+1] : 0;
+                __m256i const wv = _mm256_set1_epi32(weightPair(w[k], wb));
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), wv));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), wv));
+            }
+            // unpack and pack both work per 128 bit lane, so the values end up in order
+            lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), RowShift);
+            hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), RowShift);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packs_epi32(lo, hi));
+        }
+        _mm256_zeroupper(); // gcc does not always emit it before the tail call, which slows down the SSE code after it
+        verticalScalar(rows, w, taps, dst, i, n);
+    }
+#endif
+
+    void horizontal(int16_t const* src, uint8_t* dst, int dw, int d, Axis const& axis)
+    {
+        for (int x = 0; x < dw; ++x)
+        {
+            int16_t const* s = src + axis.start_[x]*d;
+            int16_t const* w = &axis.weights_[x*axis.taps_];
+            for (int c = 0; c < d; ++c)
+            {
+                int sum = 0;
+                for (int k = 0; k < axis.taps_; ++k)
+                {
+                    sum += w[k]*s[k*d + c];
+                }
+                sum = (sum + (1 << (FinalBits - 1))) >> FinalBits;
+                dst[x*d + c] = static_cast<uint8_t>(std::max(std::min(sum, 255), 0));
+            }
+        }
+    }
+}
+
+bool imageScalePathSupported(ImageScalePath path)
+{
+    switch (path)
+    {
+    case ImageScaleScalar:
+        return true;
+
+    case ImageScaleSse2:
+#if defined(__SSE2__)
+        return true;
+#else
+        return false;
+#endif
+
+    case ImageScaleAvx2:
+#if defined(IMAGE_SCALE_AVX2)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+ImageScalePath imageScaleBestPath()
+{
+    static ImageScalePath const path =
+        imageScalePathSupported(ImageScaleAvx2) ? ImageScaleAvx2 :
+        imageScalePathSupported(ImageScaleSse2) ? ImageScaleSse2 : ImageScaleScalar;
+    return path;
+}
+
+void scaleImage(uint8_t const* src, int sw, int sh, uint8_t* dst, int dw, int dh, int d,
+                ImageFilter filter, ImageScalePath path)
+{
+    assert(sw > 0 && sh > 0 && dw > 0 && dh > 0 && (d == 1 || d == 3));
+    assert(imageScalePathSupported(path));
+
+    Axis const axisX = makeAxis(sw, dw, filter);
+    Axis const axisY = makeAxis(sh, dh, filter);
+
+    int const n = sw*d;
+    std::vector<int16_t> row(n);
+    std::vector<uint8_t const*> rows(axisY.taps_);
+
+    for (int y = 0; y < dh; ++y)
+    {
+        for (int k = 0; k < axisY.taps_; ++k)
+        {
+            rows[k] = src + static_cast<std::size_t>(axisY.start_[y] + k)*n;
+        }
+
+        int16_t const* w = &axisY.weights_[y*axisY.taps_];
+        switch (path)
+        {
+#if defined(IMAGE_SCALE_AVX2)
+        case ImageScaleAvx2:
+            verticalAvx2(rows.data(), w, axisY.taps_, row.data(), n);
+            break;
+#endif
+#if defined(__SSE2__)
+        case ImageScaleSse2:
+            verticalSse2(rows.data(), w, axisY.taps_, row.data(), n);
+            break;
+#endif
+        default:
+            verticalScalar(rows.data(), w, axisY.taps_, row.data(), 0, n);
+            break;
+        }
+
+        horizontal(row.data(), dst + static_cast<std::size_t>(y)*dw*d, dw, d, axisX);
+    }
+}
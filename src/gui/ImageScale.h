@@ -0,0 +1,30 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include <cstdint>
+
+// resampling of 8 bit images with 1 or 3 channels, meant for downscaling to thumbnails,
+// src is sw*sh*d bytes and dst is dw*dh*d bytes, rows are not padded
+
+enum ImageFilter
+{
+    ImageFilterBox, // area average, for data like metal and height maps
+    ImageFilterLanczos // lanczos3, for pictures
+};
+
+// implementation of the vertical pass, all give identical results
+enum ImageScalePath
+{
+    ImageScaleScalar,
+    ImageScaleSse2,
+    ImageScaleAvx2
+};
+
+// returns the fastest path supported by the cpu
+ImageScalePath imageScaleBestPath();
+
+bool imageScalePathSupported(ImageScalePath path);
+
+void scaleImage(uint8_t const* src, int sw, int sh, uint8_t* dst, int dw, int dh, int d,
+                ImageFilter filter, ImageScalePath path = imageScaleBestPath());
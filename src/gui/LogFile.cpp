@@ -6,13 +6,218 @@
 #include "log/Log.h"
 
 #include <boost/filesystem.hpp>
-#include <stdexcept>
+#include <condition_variable>
+#include <unordered_map>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
 #include <ctime>
 #include <cassert>
 
 static std::string dir_;
 static bool enabled_ = false;
 
+namespace
+{
+    // writes the lines of all LogFile instances from a background thread,
+    // instances with the same path share one file which is kept open
+    class Writer
+    {
+    public:
+        Writer(): running_(false), stop_(false) {}
+        ~Writer() { stop(); }
+
+        void add(std::string const & path, std::time_t time, std::string const & text);
+        void stop();
+
+    private:
+        static std::size_t const BatchLines = 256; // wakes up the writer before the flush interval
+        static int const FlushSeconds = 1;
+        static int const IdleSeconds = 300; // files not written to for this long are closed
+
+        // created by add, after that only used by the writer thread
+        struct File
+        {
+            File(): lastWrite_(0), sessionStarted_(false), failed_(false), dirty_(false) {}
+            std::string path_;
+            std::ofstream ofs_;
+            std::time_t lastWrite_;
+            bool sessionStarted_;
+            bool failed_;
+            bool dirty_;
+        };
+
+        struct Line
+        {
+            File * file_;
+            std::time_t time_;
+            std::string text_;
+        };
+        typedef std::vector<Line> Lines;
+
+        // protected by mutex_
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        Lines lines_;
+        std::unordered_map<std::string, std::unique_ptr<File>> files_;
+        bool running_;
+        bool stop_;
+
+        std::thread thread_;
+        std::vector<File*> openFiles_; // only used by the writer thread
+
+        void run();
+        void write(Lines const & lines);
+        bool open(File & file, char const * timeStamp);
+        void close(bool all);
+    };
+
+    std::size_t const Writer::BatchLines;
+    int const Writer::FlushSeconds;
+    int const Writer::IdleSeconds;
+
+    void Writer::add(std::string const & path, std::time_t time, std::string const & text)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) return;
+
+        if (!running_)
+        {
+            thread_ = std::thread(&Writer::run, this);
+            running_ = true;
+        }
+
+        std::unique_ptr<File> & file = files_[path];
+        if (!file)
+        {
+            file.reset(new File);
+            file->path_ = path;
+        }
+
+        lines_.push_back(Line{file.get(), time, text});
+        if (lines_.size() == BatchLines)
+        {
+            cond_.notify_one();
+        }
+    }
+
+    void Writer::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            if (!running_) return;
+            running_ = false;
+        }
+        cond_.notify_one();
+        thread_.join();
+    }
+
+    void Writer::run()
+    {
+        Lines lines;
+        bool stop = false;
+        while (!stop)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait_for(lock, std::chrono::seconds(FlushSeconds),
+                    [this] { return stop_ || lines_.size() >= BatchLines; });
+                lines.swap(lines_);
+                stop = stop_;
+            }
+
+            write(lines);
+            lines.clear();
+            close(stop);
+        }
+    }
+
+    void Writer::write(Lines const & lines)
+    {
+        std::time_t lastTime = -1;
+        char timeStamp[32];
+        std::vector<File*> written;
+
+        for (Line const & line : lines)
+        {
+            File & file = *line.file_;
+            if (file.failed_) continue;
+
+            if (line.time_ != lastTime)
+            {
+                std::tm tm;
+                localtime_r(&line.time_, &tm);
+                std::strftime(timeStamp, sizeof(timeStamp), "%F %T", &tm);
+                lastTime = line.time_;
+            }
+
+            if (!file.ofs_.is_open() && !open(file, timeStamp)) continue;
+
+            file.ofs_ << timeStamp << ": " << line.text_ << '\n';
+            file.lastWrite_ = line.time_;
+            if (!file.dirty_)
+            {
+                file.dirty_ = true;
+                written.push_back(&file);
+            }
+        }
+
+        for (File * file : written)
+        {
+            file->dirty_ = false;
+            file->ofs_.flush();
+            if (!file->ofs_.good())
+            {
+                file->failed_ = true;
+                file->ofs_.close();
+                LOG(WARNING) << "problem writing to log: " << file->path_;
+            }
+        }
+    }
+
+    bool Writer::open(File & file, char const * timeStamp)
+    {
+        file.ofs_.open(file.path_, std::fstream::app);
+        if (!file.ofs_.good())
+        {
+            file.failed_ = true;
+            LOG(WARNING) << "failed to open log file: " << file.path_;
+            return false;
+        }
+        if (!file.sessionStarted_)
+        {
+            file.ofs_ << "\nNEW LOG SESSION " << timeStamp << '\n';
+            file.sessionStarted_ = true;
+        }
+        openFiles_.push_back(&file);
+        return true;
+    }
+
+    void Writer::close(bool all)
+    {
+        std::time_t const now = std::time(0);
+        std::size_t kept = 0;
+        for (File * file : openFiles_)
+        {
+            if (all || !file->ofs_.is_open() || now - file->lastWrite_ > IdleSeconds)
+            {
+                file->ofs_.close();
+            }
+            else
+            {
+                openFiles_[kept++] = file;
+            }
+        }
+        openFiles_.resize(kept);
+    }
+}
+
+static Writer writer_;
+
 LogFile::LogFile(std::string const & name):
     name_(name)
 {
@@ -38,35 +243,20 @@ std::string const & LogFile::dir()
     return dir_;
 }
 
-std::string LogFile::path()
+std::string const & LogFile::path()
 {
-    return dir() + name_ + ".log";
+    if (path_.empty())
+    {
+        path_ = dir() + name_ + ".log";
+    }
+    return path_;
 }
 
 void LogFile::log(std::string const & text)
 {
     if (!enabled_) return;
 
-    char buf[32];
-    std::time_t t = std::time(0);
-    std::tm tm = *std::localtime(&t);
-    std::strftime(buf, 32, "%F %T", &tm);
-
-    if (!ofs_.is_open())
-    {
-        std::string const fileName = path();
-        ofs_.open(fileName, std::fstream::app);
-        if (!ofs_.good())
-        {
-            throw std::runtime_error("failed to open log file: " + fileName);
-        }
-        ofs_ << "\nNEW LOG SESSION " << buf << std::endl;
-    }
-    ofs_ << buf << ": " << text << std::endl;
-    if (!ofs_.good())
-    {
-        throw std::runtime_error("problem writing to log : " + name_);
-    }
+    writer_.add(path(), std::time(0), text);
 }
 
 bool LogFile::enabled()
@@ -79,6 +269,11 @@ void LogFile::enable(bool enable)
     enabled_ = enable;
 }
 
+void LogFile::shutdown()
+{
+    writer_.stop();
+}
+
 void LogFile::openLogFile(std::string const& path)
 {
     std::string const uri = "file://" + path;
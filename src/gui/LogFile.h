@@ -3,7 +3,6 @@
 #pragma once
 
 #include <string>
-#include <fstream>
 
 class LogFile
 {
@@ -15,13 +14,14 @@ public:
     static std::string const & dir();
     static bool enabled();
     static void enable(bool enable);
+    static void shutdown(); // writes all queued lines and closes the files
 
-    std::string path();
-    void log(std::string const & text);
+    std::string const & path();
+    void log(std::string const & text); // queued, written by a background thread
 
     static void openLogFile(std::string const& path);
 
 private:
     std::string name_;
-    std::ofstream ofs_;
+    std::string path_;
 };
@@ -7,7 +7,10 @@
 
 #include <FL/Fl_Check_Button.H>
 #include <FL/Fl_Output.H>
+#include <FL/Fl_Input.H>
 #include <FL/Fl_Return_Button.H>
+#include <FL/fl_ask.H>
+#include <stdexcept>
 
 
 LoggingDialog::LoggingDialog():
@@ -21,11 +24,16 @@ LoggingDialog::LoggingDialog():
 
     logDebug_ = new Fl_Check_Button(10, 60, 380, 30, "Log debug messages");
 
-    chatLogDir_ = new Fl_Output(10, 130, 380, 30, "Chat history directory");
+    logModules_ = new Fl_Input(10, 120, 380, 30, "Module log levels");
+    logModules_->align(FL_ALIGN_TOP_LEFT);
+    logModules_->tooltip("Overrides the log level per source file, e.g. 'Model=debug, ServerConn=warning'.\n"
+                         "Levels are debug, info, warning and error.");
+
+    chatLogDir_ = new Fl_Output(10, 190, 380, 30, "Chat history directory");
     chatLogDir_->align(FL_ALIGN_TOP_LEFT);
     chatLogDir_->value(LogFile::dir().c_str());
 
-    logChats_ = new Fl_Check_Button(10, 160, 380, 30, "Log chats");
+    logChats_ = new Fl_Check_Button(10, 220, 380, 30, "Log chats");
 
     Fl_Return_Button * btn = new Fl_Return_Button(300, 360, 90, 30, "Save");
     btn->callback(LoggingDialog::callbackApply, this);
@@ -43,6 +51,10 @@ void LoggingDialog::show()
     logDebug_->value(Log::minSeverity() == Log::Debug ? 1 : 0);
     logChats_->value(LogFile::enabled() ? 1 : 0);
 
+    char str[1024];
+    prefs().get(PrefLogModules, str, "", sizeof(str));
+    logModules_->value(str);
+
     Fl_Window::show();
 }
 
@@ -50,6 +62,17 @@ void LoggingDialog::callbackApply(Fl_Widget*, void *data)
 {
     LoggingDialog * o = static_cast<LoggingDialog*>(data);
 
+    try
+    {
+        Log::moduleSeverities(o->logModules_->value());
+    }
+    catch (std::invalid_argument const & e)
+    {
+        fl_alert("Module log levels: %s", e.what());
+        return;
+    }
+    prefs().set(PrefLogModules, o->logModules_->value());
+
     prefs().set(PrefLogDebug, o->logDebug_->value());
     Log::minSeverity(o->logDebug_->value() == 1 ? Log::Debug : Log::Info);
 
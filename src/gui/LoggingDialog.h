@@ -7,6 +7,7 @@
 
 class Fl_Check_Button;
 class Fl_Output;
+class Fl_Input;
 
 class LoggingDialog: public Fl_Window
 {
@@ -19,6 +20,7 @@ public:
 private:
     Fl_Output* flobbyLogPath_;
     Fl_Check_Button* logDebug_;
+    Fl_Input* logModules_;
 
     Fl_Output* chatLogDir_;
     Fl_Check_Button* logChats_;
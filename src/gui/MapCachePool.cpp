@@ -0,0 +1,101 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#include "MapCachePool.h"
+#include "UserInterface.h"
+
+#include "log/Log.h"
+
+#include <FL/Fl.H>
+#include <algorithm>
+#include <stdexcept>
+
+MapCachePool::MapCachePool(UserInterface & ui, Cache & cache, void (*done)(void*), void * data):
+    ui_(ui),
+    cache_(cache),
+    done_(done),
+    data_(data),
+    threadCount_(std::max(std::thread::hardware_concurrency(), 1u)),
+    writing_(0),
+    stop_(false)
+{
+}
+
+MapCachePool::~MapCachePool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        imageFiles_.clear();
+        stop_ = true;
+    }
+    cond_.notify_all();
+
+    // workers can be waiting for the FLTK lock in addCallbackEvent
+    Fl::unlock();
+    for (std::thread & thread : threads_)
+    {
+        thread.join();
+    }
+    Fl::lock();
+}
+
+void MapCachePool::add(Cache::ImageFile && imageFile)
+{
+    if (threads_.empty())
+    {
+        for (std::size_t i = 0; i < threadCount_; ++i)
+        {
+            threads_.emplace_back(&MapCachePool::run, this);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        imageFiles_.push_back(std::move(imageFile));
+    }
+    cond_.notify_one();
+}
+
+void MapCachePool::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    imageFiles_.clear();
+}
+
+std::size_t MapCachePool::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return imageFiles_.size() + writing_;
+}
+
+void MapCachePool::run()
+{
+    for (;;)
+    {
+        Cache::ImageFile imageFile;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return stop_ || !imageFiles_.empty(); });
+            if (stop_) break;
+
+            imageFile = std::move(imageFiles_.front());
+            imageFiles_.pop_front();
+            ++writing_;
+        }
+
+        try
+        {
+            cache_.writeImageFile(imageFile);
+        }
+        catch (std::exception const & e)
+        {
+            LOG(WARNING) << "failed to write " << imageFile.key_ << ": " << e.what();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --writing_;
+        }
+        // not holding mutex_, the UI thread holds the FLTK lock when calling pending()
+        ui_.addCallbackEvent(done_, data_);
+    }
+}
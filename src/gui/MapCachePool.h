@@ -0,0 +1,53 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include "Cache.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+class UserInterface;
+
+// scales map cache images and adds them to the cache on a pool of worker threads,
+// done is called on the UI thread after each image
+class MapCachePool
+{
+public:
+    MapCachePool(UserInterface & ui, Cache & cache, void (*done)(void*), void * data);
+    virtual ~MapCachePool(); // waits for the images being written
+
+    void add(Cache::ImageFile && imageFile);
+    void clear(); // drops images not yet being written
+    std::size_t pending(); // images queued or being written
+    std::size_t threads() const;
+
+private:
+    UserInterface & ui_;
+    Cache & cache_;
+    void (*done_)(void*);
+    void * data_;
+
+    std::size_t const threadCount_;
+    std::vector<std::thread> threads_; // started by first add
+
+    // protected by mutex_
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Cache::ImageFile> imageFiles_;
+    std::size_t writing_;
+    bool stop_;
+
+    void run();
+};
+
+// inline methods
+
+inline std::size_t MapCachePool::threads() const
+{
+    return threadCount_;
+}
@@ -0,0 +1,333 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#include "MapInfoIndex.h"
+
+#include "log/Log.h"
+
+#include <boost/crc.hpp>
+#include <stdexcept>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+// File layout: FileHeader followed by records of RecordHeader and payload. The payload is the key
+// and the MapInfo fields, strings are prefixed with their size. Records are only appended, a later
+// record replaces an earlier one with the same key.
+
+namespace
+{
+    char const FileMagic[8] = { 'f', 'l', 'o', 'b', 'b', 'y', 'M', 'I' };
+    uint32_t const FileVersion = 1; // increase when the MapInfo fields change
+
+    // compact when more than half of the records are replaced
+    std::size_t const CompactMinRecords = 64;
+
+    bool needsCompaction(std::size_t records, std::size_t mapInfos)
+    {
+        return records >= CompactMinRecords && records > 2*mapInfos;
+    }
+
+    struct FileHeader
+    {
+        char magic_[8];
+        uint32_t version_;
+        uint32_t reserved_;
+    };
+
+    struct RecordHeader
+    {
+        uint32_t size_; // of the payload
+        uint32_t crc_; // of the payload
+    };
+
+    uint32_t crc(char const* data, std::size_t size)
+    {
+        boost::crc_32_type crc;
+        crc.process_bytes(data, size);
+        return crc.checksum();
+    }
+
+    void put(std::string & out, uint32_t value)
+    {
+        out.append(reinterpret_cast<char const*>(&value), sizeof(value));
+    }
+
+    void put(std::string & out, std::string const& value)
+    {
+        put(out, static_cast<uint32_t>(value.size()));
+        out.append(value);
+    }
+
+    uint32_t getUint(char const*& p, char const* end)
+    {
+        uint32_t value;
+        if (end - p < static_cast<std::ptrdiff_t>(sizeof(value)))
+        {
+            throw std::runtime_error("record too short");
+        }
+        std::memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return value;
+    }
+
+    std::string getString(char const*& p, char const* end)
+    {
+        uint32_t const size = getUint(p, end);
+        if (static_cast<uint32_t>(end - p) < size)
+        {
+            throw std::runtime_error("record too short");
+        }
+        std::string value(p, size);
+        p += size;
+        return value;
+    }
+
+    std::string encode(std::string const& key, MapInfo const& mapInfo)
+    {
+        std::string payload;
+        put(payload, key);
+        put(payload, mapInfo.name_);
+        put(payload, mapInfo.fileName_);
+        put(payload, mapInfo.description_);
+        put(payload, mapInfo.author_);
+        put(payload, mapInfo.checksum_);
+        put(payload, static_cast<uint32_t>(mapInfo.width_));
+        put(payload, static_cast<uint32_t>(mapInfo.height_));
+        put(payload, static_cast<uint32_t>(mapInfo.tidalStrength_));
+        put(payload, static_cast<uint32_t>(mapInfo.windMin_));
+        put(payload, static_cast<uint32_t>(mapInfo.windMax_));
+        put(payload, static_cast<uint32_t>(mapInfo.gravity_));
+
+        std::string record;
+        put(record, static_cast<uint32_t>(payload.size()));
+        put(record, crc(payload.data(), payload.size()));
+        record.append(payload);
+        return record;
+    }
+
+    // throws if the payload is too short
+    void decode(char const* p, char const* end, std::string & key, MapInfo & mapInfo)
+    {
+        key = getString(p, end);
+        mapInfo.name_ = getString(p, end);
+        mapInfo.fileName_ = getString(p, end);
+        mapInfo.description_ = getString(p, end);
+        mapInfo.author_ = getString(p, end);
+        mapInfo.checksum_ = getUint(p, end);
+        mapInfo.width_ = static_cast<int>(getUint(p, end));
+        mapInfo.height_ = static_cast<int>(getUint(p, end));
+        mapInfo.tidalStrength_ = static_cast<int>(getUint(p, end));
+        mapInfo.windMin_ = static_cast<int>(getUint(p, end));
+        mapInfo.windMax_ = static_cast<int>(getUint(p, end));
+        mapInfo.gravity_ = static_cast<int>(getUint(p, end));
+    }
+
+    std::string fileHeader()
+    {
+        FileHeader header;
+        std::memcpy(header.magic_, FileMagic, sizeof(FileMagic));
+        header.version_ = FileVersion;
+        header.reserved_ = 0;
+        return std::string(reinterpret_cast<char const*>(&header), sizeof(header));
+    }
+}
+
+MapInfoIndex::MapInfoIndex(std::string const & path):
+    path_(path),
+    records_(0),
+    lockFd_(-1),
+    writable_(false)
+{
+    std::string const lockPath = path_ + ".lock";
+    lockFd_ = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd_ < 0)
+    {
+        LOG(WARNING) << "failed to open " << lockPath << ": " << std::strerror(errno) << ", new map infos are not saved";
+    }
+    else if (::flock(lockFd_, LOCK_EX | LOCK_NB) != 0)
+    {
+        LOG(WARNING) << path_ << " is used by another flobby, new map infos are not saved";
+    }
+    else
+    {
+        writable_ = true;
+    }
+
+    bool const clean = load();
+    if (!writable_) return;
+
+    try
+    {
+        if (!clean || needsCompaction(records_, mapInfos_.size()))
+        {
+            compact();
+        }
+    }
+    catch (std::exception const & e)
+    {
+        LOG(WARNING) << "failed to rewrite " << path_ << ": " << e.what();
+    }
+
+    ofs_.open(path_, std::ios::binary | std::ios::app);
+    if (!ofs_.good())
+    {
+        LOG(WARNING) << "failed to open " << path_ << " for writing, new map infos are not saved";
+    }
+}
+
+MapInfoIndex::~MapInfoIndex()
+{
+    ofs_.close();
+    if (lockFd_ >= 0)
+    {
+        ::close(lockFd_); // releases the lock
+    }
+}
+
+bool MapInfoIndex::load()
+{
+    std::ifstream ifs(path_, std::ios::binary | std::ios::ate);
+    if (!ifs.good()) return false;
+
+    std::vector<char> data(static_cast<std::size_t>(ifs.tellg()));
+    ifs.seekg(0);
+    if (!ifs.read(data.data(), data.size()))
+    {
+        LOG(WARNING) << "failed to read " << path_;
+        return false;
+    }
+
+    char const* p = data.data();
+    char const* const end = p + data.size();
+
+    FileHeader header;
+    if (data.size() >= sizeof(header))
+    {
+        std::memcpy(&header, p, sizeof(header));
+    }
+    if (data.size() < sizeof(header) ||
+        std::memcmp(header.magic_, FileMagic, sizeof(FileMagic)) != 0 || header.version_ != FileVersion)
+    {
+        LOG(INFO) << "unknown map info file format, recreating " << path_;
+        return false;
+    }
+    p += sizeof(header);
+
+    while (p != end)
+    {
+        RecordHeader record;
+        if (end - p < static_cast<std::ptrdiff_t>(sizeof(record)))
+        {
+            break;
+        }
+        std::memcpy(&record, p, sizeof(record));
+        char const* const payload = p + sizeof(record);
+        if (static_cast<std::size_t>(end - payload) < record.size_ || crc(payload, record.size_) != record.crc_)
+        {
+            break;
+        }
+
+        std::string key;
+        MapInfo mapInfo;
+        try
+        {
+            decode(payload, payload + record.size_, key, mapInfo);
+        }
+        catch (std::exception const &)
+        {
+            break;
+        }
+        mapInfos_[key] = mapInfo;
+        ++records_;
+        p = payload + record.size_;
+    }
+
+    if (p != end)
+    {
+        LOG(WARNING) << "dropping damaged end of " << path_ << " at " << (p - data.data()) << " of " << data.size() << " bytes";
+        return false;
+    }
+    LOG(INFO) << "loaded " << mapInfos_.size() << " map infos from " << path_;
+    return true;
+}
+
+void MapInfoIndex::compact()
+{
+    if (!writable_)
+    {
+        throw std::runtime_error("not holding the lock of " + path_);
+    }
+
+    std::string const tmpPath = path_ + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+        ofs << fileHeader();
+        for (auto const & pair : mapInfos_)
+        {
+            ofs << encode(pair.first, pair.second);
+        }
+        ofs.close();
+        if (!ofs)
+        {
+            std::remove(tmpPath.c_str());
+            throw std::runtime_error("failed to write " + tmpPath);
+        }
+    }
+
+    bool const appending = ofs_.is_open();
+    ofs_.close();
+    if (std::rename(tmpPath.c_str(), path_.c_str()) != 0)
+    {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("failed to rename " + tmpPath);
+    }
+    records_ = mapInfos_.size();
+
+    if (appending)
+    {
+        ofs_.open(path_, std::ios::binary | std::ios::app);
+    }
+}
+
+MapInfo const* MapInfoIndex::find(std::string const & key) const
+{
+    auto it = mapInfos_.find(key);
+    return it != mapInfos_.end() ? &it->second : 0;
+}
+
+MapInfo const& MapInfoIndex::add(std::string const & key, MapInfo const & mapInfo)
+{
+    MapInfo & res = mapInfos_[key] = mapInfo;
+
+    if (ofs_.is_open() && ofs_.good())
+    {
+        ofs_ << encode(key, mapInfo);
+        ofs_.flush();
+        if (ofs_.good())
+        {
+            ++records_;
+        }
+        else
+        {
+            LOG(WARNING) << "failed to write " << path_ << ", new map infos are not saved";
+        }
+    }
+
+    if (ofs_.is_open() && needsCompaction(records_, mapInfos_.size()))
+    {
+        try
+        {
+            compact();
+        }
+        catch (std::exception const & e)
+        {
+            LOG(WARNING) << "failed to rewrite " << path_ << ": " << e.what();
+        }
+    }
+    return res;
+}
@@ -0,0 +1,45 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include "model/MapInfo.h"
+
+#include <unordered_map>
+#include <fstream>
+#include <string>
+#include <cstddef>
+
+// single binary file holding the cached MapInfo of all maps, keyed by "<mapname>_<chksum>",
+// read at once when opened, new infos are appended, not thread safe
+class MapInfoIndex
+{
+public:
+    // starts empty if the file is missing or unusable, rewrites the file if it is damaged or
+    // has many replaced records, new infos are only kept in memory if another flobby uses the file
+    MapInfoIndex(std::string const& path);
+    virtual ~MapInfoIndex();
+
+    MapInfo const* find(std::string const& key) const; // returns 0 if not found
+    // kept in memory only if writing fails, rewrites the file once many records are replaced
+    MapInfo const& add(std::string const& key, MapInfo const& mapInfo);
+    std::size_t size() const;
+
+    void compact(); // rewrites the file without replaced records, throws on error or if not writable
+
+private:
+    std::string const path_;
+    std::unordered_map<std::string, MapInfo> mapInfos_;
+    std::size_t records_; // in the file, including replaced ones
+    int lockFd_; // -1 if not open
+    bool writable_; // holding the lock, the file itself is replaced when compacting so <path>.lock is locked
+    std::ofstream ofs_; // appending
+
+    bool load(); // returns false if the file is missing or damaged
+};
+
+// inline methods
+
+inline std::size_t MapInfoIndex::size() const
+{
+    return mapInfos_.size();
+}
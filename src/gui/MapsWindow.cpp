@@ -4,17 +4,20 @@
 #include "PopupMenu.h"
 #include "Prefs.h"
 #include "Cache.h"
+#include "MapCachePool.h"
 
 #include "model/Model.h"
+#include "log/Log.h"
 
 #include <FL/Fl.H>
 #include <FL/fl_draw.H>
-#include <FL/Fl_Shared_Image.H>
+#include <FL/Fl_Image.H>
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Scrollbar.H>
 #include <FL/Fl_Tooltip.H>
 
 #include <algorithm>
+#include <stdexcept>
 #include <boost/algorithm/string.hpp>
 
 static char const * PrefWindowX = "WindowX";
@@ -25,11 +28,16 @@ static char const * PrefWindowH = "WindowH";
 // Fl_Tooltip::margin_width/height() not available in FLTK 1.3.0
 static int const MARGIN = 3;
 
-MapsWindow::MapsWindow(Model & model, Cache& cache):
+// images are loaded for one screen above and below the visible part and released beyond three
+static int const PREFETCH_SCREENS = 1;
+static int const RELEASE_SCREENS = 3;
+
+MapsWindow::MapsWindow(UserInterface & ui, Model & model, Cache& cache):
     Fl_Double_Window(100, 100, "Maps"),
     model_(model),
     cache_(cache),
-    prefs_(prefs(), label())
+    prefs_(prefs(), label()),
+    mapCachePool_(new MapCachePool(ui, cache, loadImages, this))
 {
     int const scrollW = Fl::scrollbar_size();
     mapArea_ = new MapArea(0, 0, w()-scrollW, h(), model);
@@ -51,6 +59,9 @@ MapsWindow::MapsWindow(Model & model, Cache& cache):
 
 MapsWindow::~MapsWindow()
 {
+    Fl::remove_timeout(loadImages, this);
+    mapCachePool_.reset();
+
     prefs_.set(PrefWindowX, x_root());
     prefs_.set(PrefWindowY, y_root());
     prefs_.set(PrefWindowW, w());
@@ -68,6 +79,148 @@ void MapsWindow::onScrollbar()
     mapArea_->pos_ = scrollbar_->value();
     mapArea_->updateMapInfoWin(Fl::event_x(), Fl::event_y());
     mapArea_->redraw();
+    startLoading();
+}
+
+void MapsWindow::startLoading()
+{
+    if (!Fl::has_timeout(loadImages, this))
+    {
+        Fl::add_timeout(0, loadImages, this);
+    }
+}
+
+void MapsWindow::loadImages(void* data)
+{
+    MapsWindow* mw = static_cast<MapsWindow*>(data);
+    mw->loadImages();
+}
+
+void MapsWindow::loadImages()
+{
+    // iconified windows get FL_HIDE but stay shown()
+    if (!shown() || !visible() || imageStates_.size() != mapArea_->names_.size()) return;
+
+    MapArea & area = *mapArea_;
+    int const perLine = area.mapsPerLine();
+    int const count = area.names_.size();
+    int const first = area.firstLineVisible();
+    int const last = area.lastLineVisible();
+
+    // visible lines first, then alternating below and above
+    std::vector<int> lines;
+    for (int line = first; line <= last; ++line)
+    {
+        lines.push_back(line);
+    }
+    int const prefetch = PREFETCH_SCREENS*area.linesVisible();
+    for (int i = 1; i <= prefetch; ++i)
+    {
+        lines.push_back(last + i);
+        lines.push_back(first - i);
+    }
+
+    bool more = false;
+    bool extracted = false;
+    for (int line : lines)
+    {
+        int const begin = std::max(line*perLine, 0);
+        int const end = std::min((line + 1)*perLine, count);
+        for (int i = begin; i < end; ++i)
+        {
+            if (loadImage(i, extracted))
+            {
+                more = true;
+            }
+        }
+    }
+
+    releaseImages();
+
+    // otherwise the pool is full and its done callback continues
+    if (more && extracted && !Fl::has_timeout(loadImages, this))
+    {
+        Fl::add_timeout(0.01, loadImages, this);
+    }
+}
+
+bool MapsWindow::loadImage(int index, bool & extracted)
+{
+    std::string const & name = mapArea_->names_[index];
+    ImageState & state = imageStates_[index];
+
+    try
+    {
+        switch (state)
+        {
+        case IMAGE_NONE:
+        case IMAGE_QUEUED:
+            if (cache_.hasMapImage(name))
+            {
+                mapArea_->images_[index] = cache_.getMapImage(name);
+                state = IMAGE_LOADED;
+                mapArea_->redraw();
+            }
+            else if (state == IMAGE_QUEUED)
+            {
+                if (mapCachePool_->pending() == 0)
+                {
+                    state = IMAGE_MISSING; // failed to write
+                }
+            }
+            else if (!extracted && mapCachePool_->pending() < 2*mapCachePool_->threads())
+            {
+                // unitsync is not thread safe, one map is extracted per call to keep the window responsive
+                extracted = true;
+                Cache::ImageFile imageFile;
+                if (cache_.extractMapImage(name, imageFile))
+                {
+                    mapCachePool_->add(std::move(imageFile));
+                    state = IMAGE_QUEUED;
+                }
+                else
+                {
+                    state = IMAGE_MISSING;
+                }
+            }
+            else
+            {
+                return true;
+            }
+            break;
+
+        case IMAGE_LOADED:
+        case IMAGE_MISSING:
+            break;
+        }
+    }
+    catch (std::exception const & e)
+    {
+        LOG(WARNING) << "failed to load image of " << name << ": " << e.what();
+        state = IMAGE_MISSING;
+    }
+    return false;
+}
+
+void MapsWindow::releaseImages()
+{
+    MapArea & area = *mapArea_;
+    int const perLine = area.mapsPerLine();
+    int const keep = RELEASE_SCREENS*area.linesVisible();
+    int const first = area.firstLineVisible() - keep;
+    int const last = area.lastLineVisible() + keep;
+
+    for (std::size_t i = 0; i < area.images_.size(); ++i)
+    {
+        int const line = i/perLine;
+        if (area.images_[i] != 0 && (line < first || line > last))
+        {
+            // frees the server side copy, the pixels stay in the cache
+            area.images_[i]->uncache();
+            area.images_[i] = 0;
+            imageStates_[i] = IMAGE_NONE;
+        }
+    }
 }
 
 int MapsWindow::handle(int event)
@@ -84,16 +237,28 @@ int MapsWindow::handle(int event)
 
         std::sort(mapArea_->names_.begin(), mapArea_->names_.end(), comp);
 
-        mapArea_->images_.clear();
-        for (auto const& name : mapArea_->names_)
-        {
-            Fl_Shared_Image* im = cache_.getMapImage(name);
-            mapArea_->images_.push_back(im);
-        }
+        // images are loaded after the window is shown
+        mapArea_->images_.assign(mapArea_->names_.size(), 0);
+        imageStates_.assign(mapArea_->names_.size(), IMAGE_NONE);
+        mapArea_->pos_ = 0;
         scrollbar_->value(0, mapArea_->h(), 0, mapArea_->lines()*MapArea::SIZE_);
+        startLoading();
 
     } break;
 
+    case FL_HIDE:
+        // also sent when iconified, the images are kept and loading continues when shown again
+        Fl::remove_timeout(loadImages, this);
+        mapCachePool_->clear();
+        for (std::size_t i = 0; i < imageStates_.size(); ++i)
+        {
+            if (mapArea_->images_[i]) mapArea_->images_[i]->uncache();
+
+            // images being written are found in the cache, dropped ones are extracted again
+            if (imageStates_[i] == IMAGE_QUEUED) imageStates_[i] = IMAGE_NONE;
+        }
+        break;
+
     }
 
     return Fl_Double_Window::handle(event);
@@ -184,7 +349,18 @@ void MapsWindow::MapArea::draw()
             break;
 
         if (im)
+        {
             im->draw(x + SIZE_/2 - im->w()/2, y + SIZE_/2 - im->h()/2);
+        }
+        else
+        {
+            // placeholder until the image is loaded
+            fl_color(FL_INACTIVE_COLOR);
+            fl_rect(x + 1, y + 1, SIZE_ - 2, SIZE_ - 2);
+            fl_font(FL_HELVETICA, FL_NORMAL_SIZE);
+            fl_draw(names_[i].c_str(), x + MARGIN, y + MARGIN, SIZE_ - 2*MARGIN, SIZE_ - 2*MARGIN,
+                    Fl_Align(FL_ALIGN_CENTER|FL_ALIGN_WRAP|FL_ALIGN_CLIP));
+        }
 
         x += SIZE_;
     }
@@ -275,6 +451,16 @@ int MapsWindow::MapArea::linesVisible() const
     return std::max(lines, 1);
 }
 
+int MapsWindow::MapArea::firstLineVisible() const
+{
+    return pos_/SIZE_;
+}
+
+int MapsWindow::MapArea::lastLineVisible() const
+{
+    return (pos_ + h() - 1)/SIZE_;
+}
+
 int MapsWindow::MapArea::lines() const
 {
     int const lines = 1 + names_.size()/mapsPerLine();
@@ -8,24 +8,39 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
 
+class UserInterface;
 class Model;
 class Cache;
-class Fl_Shared_Image;
+class MapCachePool;
+class Fl_Image;
 class Fl_Box;
 class Fl_Scrollbar;
 
+// shows the minimaps of all maps, the images are loaded when they are visible or near the
+// visible part and missing images are generated in the background
 class MapsWindow: public Fl_Double_Window
 {
 public:
-    MapsWindow(Model & model, Cache& cache);
+    MapsWindow(UserInterface & ui, Model & model, Cache& cache);
     virtual ~MapsWindow();
 
 private:
     Model& model_;
     Cache& cache_;
     Fl_Preferences prefs_;
+    std::unique_ptr<MapCachePool> mapCachePool_; // scales and writes generated images
+
+    enum ImageState
+    {
+        IMAGE_NONE,
+        IMAGE_QUEUED, // being generated
+        IMAGE_LOADED,
+        IMAGE_MISSING // could not be generated
+    };
+    std::vector<ImageState> imageStates_;
 
     struct MapArea: public Fl_Widget
     {
@@ -40,7 +55,7 @@ private:
         };
 
         std::vector<std::string> names_;
-        std::vector<Fl_Shared_Image*> images_;
+        std::vector<Fl_Image*> images_; // 0 until loaded
         static const int SIZE_ = 128+2;
         int pos_;
 
@@ -57,12 +72,19 @@ private:
         int mapsPerLine() const;
         int linesVisible() const;
         int lines() const;
+        int firstLineVisible() const;
+        int lastLineVisible() const;
     };
     MapArea* mapArea_;
     Fl_Scrollbar* scrollbar_;
 
     static void callbackScrollbar(Fl_Widget*, void*);
     void onScrollbar();
+    void startLoading();
+    static void loadImages(void* data);
+    void loadImages();
+    bool loadImage(int index, bool & extracted); // returns true if the image needs more work
+    void releaseImages();
     int handle(int event);
     void draw();
     void resize(int x, int y, int w, int h);
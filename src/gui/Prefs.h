@@ -21,6 +21,11 @@ char const * const PrefLoginPassword = "Password";
 
 char const * const PrefLogDebug = "LogDebug";
 char const * const PrefLogChats = "LogChats";
+char const * const PrefLogModules = "LogModules";
+char const * const PrefLogMaxSize = "LogMaxSize"; // MB
+char const * const PrefLogMaxAge = "LogMaxAge"; // hours
+char const * const PrefLogKeepFiles = "LogKeepFiles";
+char const * const PrefLogCompress = "LogCompress";
 
 struct BattleChatSettings
 {
@@ -49,6 +49,7 @@ PrivateChatTab::PrivateChatTab(int x, int y, int w, int h, std::string const & u
 
     model_.connectUserJoinedBattle( boost::bind(&PrivateChatTab::userJoinedBattle, this, _1, _2) );
     model_.connectUserLeftBattle( boost::bind(&PrivateChatTab::userLeftBattle, this, _1, _2) );
+    model_.connectBattleClosed( boost::bind(&PrivateChatTab::battleClosed, this, _1, _2) );
 
     Fl::focus(input_);
 }
@@ -143,6 +144,14 @@ void PrivateChatTab::userLeftBattle(User const & user, Battle const & battle)
     }
 }
 
+void PrivateChatTab::battleClosed(Battle const & battle, Battle::BattleUsers const & leftUsers)
+{
+    if (leftUsers.find(userName_) != leftUsers.end())
+    {
+        append(userName_ + " left " + battle.title(), -1);
+    }
+}
+
 void PrivateChatTab::append(std::string const & msg, int interest)
 {
     logFile_.log(msg);
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "LogFile.h"
+#include "model/Battle.h"
 
 #include <FL/Fl_Group.H>
 #include <string>
@@ -50,4 +51,5 @@ private:
     void userLeft(User const & user);
     void userJoinedBattle(User const & user, Battle const & battle);
     void userLeftBattle(User const & user, Battle const & battle);
+    void battleClosed(Battle const & battle, Battle::BattleUsers const & leftUsers);
 };
@@ -1,6 +1,7 @@
 // This file is part of flobby (GPL v2 or later), see the LICENSE file
 
 #include "StringTable.h"
+#include "FrameScheduler.h"
 #include "log/Log.h"
 #include "Prefs.h"
 
@@ -10,6 +11,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
 #include <algorithm>            // STL sort
+#include <cstdlib>
 #include <cassert>
 #include <stdexcept>
 
@@ -25,6 +27,8 @@ StringTable::StringTable(int x, int y, int w, int h, std::string const & name,
     Fl_Table_Row(x,y,w,h, name.c_str()),
     selectedRow_(-1),
     headers_(headers),
+    pendingFirst_(0),
+    pendingLast_(0),
     prefs_(prefs(), label()),
     savePrefs_(savePrefs)
 {
@@ -56,12 +60,16 @@ StringTable::StringTable(int x, int y, int w, int h, std::string const & name,
     prefs_.get(PrefSortCol, sort_lastcol_, std::abs(defaultSortColumn));
     prefs_.get(PrefSortReverse, sort_reverse_, defaultSortColumn < 0 ? 1 : 0);
 
+    // uniform row height
+    rowHeight_ = col_header_height()+2;
+
     // adjust linesize
-    vscrollbar->linesize(col_header_height()+2);
+    vscrollbar->linesize(rowHeight_);
 }
 
 StringTable::~StringTable()
 {
+    FrameScheduler::cancel(this);
 }
 
 void StringTable::savePrefs()
@@ -94,13 +102,142 @@ void StringTable::sort_column(int col, int reverse)
         assert(selectedRow_ >= 0 && selectedRow_ < rows());
         id = rows_[selectedRow_].id_;
     }
-    std::stable_sort(rows_.begin(), rows_.end(), SortColumn(col, reverse));
+    std::stable_sort(rows_.begin(), rows_.end(), sortColumn(col, reverse));
+    reindex(0, rows_.size());
 
     if (!id.empty())
     {
         selectRow(id);
     }
-    redraw();
+
+    if (col != sort_lastcol_ || reverse != sort_reverse_)
+    {
+        // header sort arrow changed
+        sort_lastcol_ = col;
+        sort_reverse_ = reverse;
+        redraw();
+    }
+    else
+    {
+        redrawRows(0, rows_.size());
+    }
+}
+
+std::size_t StringTable::sortedPosition(StringTableRow const & row, std::size_t first, std::size_t last)
+{
+    // upper bound to place row after equal rows, same as stable_sort would do for an appended row
+    return std::upper_bound(rows_.begin() + first, rows_.begin() + last, row, sortColumn(sort_lastcol_, sort_reverse_)) - rows_.begin();
+}
+
+void StringTable::makeSortKeys(StringTableRow & row)
+{
+    std::size_t const cols = headers_.size();
+    row.sortText_.resize(cols);
+    row.sortNumber_.resize(cols);
+
+    for (std::size_t c = 0; c < cols; ++c)
+    {
+        std::string const & text = row.data_[c];
+        if (headers_[c].numeric_)
+        {
+            row.sortText_[c].clear();
+            row.sortNumber_[c] = std::strtol(text.c_str(), 0, 10); // zero if no leading integer
+        }
+        else
+        {
+            row.sortText_[c].assign(text);
+            boost::to_upper(row.sortText_[c]);
+            row.sortNumber_[c] = 0;
+        }
+    }
+}
+
+void StringTable::moveRow(std::size_t from, std::size_t to)
+{
+    if (from == to)
+    {
+        return;
+    }
+
+    if (from < to)
+    {
+        std::rotate(rows_.begin() + from, rows_.begin() + from + 1, rows_.begin() + to + 1);
+        reindex(from, to + 1);
+        if (selectedRow_ == static_cast<int>(from))
+        {
+            selectedRow_ = static_cast<int>(to);
+        }
+        else if (selectedRow_ > static_cast<int>(from) && selectedRow_ <= static_cast<int>(to))
+        {
+            selectedRow_ -= 1;
+        }
+    }
+    else
+    {
+        std::rotate(rows_.begin() + to, rows_.begin() + from, rows_.begin() + from + 1);
+        reindex(to, from + 1);
+        if (selectedRow_ == static_cast<int>(from))
+        {
+            selectedRow_ = static_cast<int>(to);
+        }
+        else if (selectedRow_ >= static_cast<int>(to) && selectedRow_ < static_cast<int>(from))
+        {
+            selectedRow_ += 1;
+        }
+    }
+}
+
+void StringTable::reindex(std::size_t first, std::size_t last)
+{
+    for (std::size_t i = first; i < last; ++i)
+    {
+        rowIndex_[rows_[i].id_] = i;
+    }
+}
+
+void StringTable::resizeRows()
+{
+    // Fl_Table gives new rows the height of the last row, so heights only need setting when growing from empty
+    bool const wasEmpty = (rows() == 0);
+    rows( static_cast<int>(rows_.size()) );
+    if (wasEmpty && !rows_.empty())
+    {
+        row_height_all(rowHeight_);
+    }
+}
+
+void StringTable::redrawRows(std::size_t first, std::size_t last)
+{
+    if (first >= last)
+    {
+        return;
+    }
+
+    // rows shifted by later changes are covered since inserts, removes and moves
+    // mark all rows from the change to the end or between old and new position
+    if (pendingFirst_ == pendingLast_)
+    {
+        pendingFirst_ = static_cast<int>(first);
+        pendingLast_ = static_cast<int>(last);
+        FrameScheduler::update(this, [this]() { redrawPendingRows(); });
+    }
+    else
+    {
+        pendingFirst_ = std::min(pendingFirst_, static_cast<int>(first));
+        pendingLast_ = std::max(pendingLast_, static_cast<int>(last));
+    }
+}
+
+void StringTable::redrawPendingRows()
+{
+    int const top = std::max(pendingFirst_, toprow);
+    int const bottom = std::min(std::min(pendingLast_, rows()) - 1, botrow);
+    pendingFirst_ = pendingLast_ = 0;
+
+    if (top <= bottom)
+    {
+        redraw_range(top, bottom, leftcol, rightcol);
+    }
 }
 
 // Draw sort arrow
@@ -212,89 +349,208 @@ void StringTable::addRow(const StringTableRow & row)
     assert(row.data_.size() == headers_.size());
 
     // check row does not exist
-    for (StringTableRow const & r : rows_)
+    if (rowIndex_.count(row.id_) != 0)
+    {
+        throw std::runtime_error("row already exist: " + row.id_);
+    }
+
+    StringTableRow r(row);
+    makeSortKeys(r);
+
+    // insert at sorted position
+    std::size_t const pos = sortedPosition(r, 0, rows_.size());
+    rows_.insert(rows_.begin() + pos, std::move(r));
+    reindex(pos, rows_.size());
+    if (selectedRow_ >= static_cast<int>(pos))
+    {
+        selectedRow_ += 1;
+    }
+
+    resizeRows();
+    redrawRows(pos, rows_.size());
+}
+
+void StringTable::addRows(std::vector<StringTableRow> const & rows)
+{
+    std::string selectedId;
+    if (selectedRow_ != -1)
+    {
+        selectedId = rows_[selectedRow_].id_;
+    }
+
+    std::size_t const oldSize = rows_.size();
+    bool updated = false;
+
+    rows_.reserve(oldSize + rows.size());
+    for (StringTableRow const & row : rows)
     {
-        if (row.id_ == r.id_)
+        assert(row.data_.size() == headers_.size());
+
+        RowIndex::const_iterator it = rowIndex_.find(row.id_);
+        if (it == rowIndex_.end())
         {
-            throw std::runtime_error("row already exist: " + row.id_);
+            rowIndex_[row.id_] = rows_.size();
+            rows_.push_back(row);
+            makeSortKeys(rows_.back());
+        }
+        else if (rows_[it->second].data_ != row.data_)
+        {
+            rows_[it->second].data_ = row.data_;
+            makeSortKeys(rows_[it->second]);
+            updated = true;
         }
     }
 
-    rows_.push_back(row);
-    rows( static_cast<int>(rows_.size()) );
-    row_height(rows()-1, col_header_height()+2);
+    if (rows_.size() == oldSize && !updated)
+    {
+        return;
+    }
+
+    SortColumn const less = sortColumn(sort_lastcol_, sort_reverse_);
+    if (updated)
+    {
+        std::stable_sort(rows_.begin(), rows_.end(), less);
+    }
+    else
+    {
+        // only new rows, existing rows are already sorted
+        std::stable_sort(rows_.begin() + oldSize, rows_.end(), less);
+        std::inplace_merge(rows_.begin(), rows_.begin() + oldSize, rows_.end(), less);
+    }
+    reindex(0, rows_.size());
 
-    // instant sort
-    sort();
+    selectedRow_ = -1;
+    if (!selectedId.empty())
+    {
+        selectRow(selectedId);
+    }
+
+    resizeRows();
+    redrawRows(0, rows_.size());
 }
 
 void StringTable::updateRow(const StringTableRow & row)
 {
-    int i = 0;
-    for (StringTableRow & r : rows_)
+    RowIndex::const_iterator it = rowIndex_.find(row.id_);
+    if (it == rowIndex_.end())
     {
-        if (row.id_ == r.id_)
-        {
-            // only redraw if content changed
-            if (r.data_ != row.data_)
-            {
-                r.data_ = row.data_;
+        throw std::runtime_error("row not found:" + row.id_);
+    }
 
-                // instant sort
-                sort();
-            }
-            return;
+    std::size_t const pos = it->second;
+    StringTableRow & r = rows_[pos];
+
+    // only redraw if content changed
+    if (r.data_ != row.data_)
+    {
+        r.data_ = row.data_;
+        makeSortKeys(r);
+
+        // move row to its new sorted position if it is out of order with its neighbours
+        SortColumn const less = sortColumn(sort_lastcol_, sort_reverse_);
+        std::size_t newPos = pos;
+        if (pos > 0 && less(r, rows_[pos-1]))
+        {
+            newPos = sortedPosition(r, 0, pos);
         }
-        ++i;
-    }
+        else if (pos+1 < rows_.size() && less(rows_[pos+1], r))
+        {
+            newPos = sortedPosition(r, pos+1, rows_.size()) - 1;
+        }
+        moveRow(pos, newPos);
 
-    // only reached if row not found
-    throw std::runtime_error("row not found:" + row.id_);
+        // only rows between old and new position changed
+        redrawRows(std::min(pos, newPos), std::max(pos, newPos) + 1);
+    }
 }
 
 void StringTable::removeRow(std::string const & id)
 {
-    int row = 0;
-    for (std::vector<StringTableRow>::iterator it = rows_.begin(); it != rows_.end(); ++it)
+    RowIndex::iterator it = rowIndex_.find(id);
+    if (it == rowIndex_.end())
     {
-        if (id == it->id_)
-        {
-            if (selectedRow_ == row)
-            {
-                selectedRow_ = -1;
-            }
-            if (selectedRow_ > row)
-            {
-                selectedRow_ -= 1;
-            }
-            rows_.erase(it);
-            rows(rows_.size());
-
-            return;
-        }
-        ++row;
+        throw std::runtime_error("row not found:" + id);
     }
 
-    // only reached if row not found
-    throw std::runtime_error("row not found:" + id);
+    int const row = static_cast<int>(it->second);
+    if (selectedRow_ == row)
+    {
+        selectedRow_ = -1;
+    }
+    if (selectedRow_ > row)
+    {
+        selectedRow_ -= 1;
+    }
+    rowIndex_.erase(it);
+    rows_.erase(rows_.begin() + row);
+    reindex(row, rows_.size());
+    resizeRows();
+    redrawRows(row, rows_.size());
 }
 
-bool StringTable::rowExist(std::string const & id)
+void StringTable::setRows(std::vector<StringTableRow> const & rows)
 {
-    for (StringTableRow & r : rows_)
+    std::string selectedId;
+    if (selectedRow_ != -1)
     {
-        if (r.id_ == id)
+        selectedId = rows_[selectedRow_].id_;
+    }
+
+    RowIndex newIndex;
+    for (StringTableRow const & row : rows)
+    {
+        assert(row.data_.size() == headers_.size());
+
+        if (!newIndex.insert(std::make_pair(row.id_, 0)).second)
         {
-            return true;
+            throw std::runtime_error("row already exist: " + row.id_);
         }
     }
-    return false;
+
+    std::vector<StringTableRow> newRows;
+    newRows.reserve(rows.size());
+
+    for (StringTableRow const & row : rows)
+    {
+        // keep sort keys of unchanged rows
+        RowIndex::const_iterator it = rowIndex_.find(row.id_);
+        if (it != rowIndex_.end() && rows_[it->second].data_ == row.data_)
+        {
+            newRows.push_back(std::move(rows_[it->second]));
+        }
+        else
+        {
+            newRows.push_back(row);
+            makeSortKeys(newRows.back());
+        }
+    }
+
+    std::stable_sort(newRows.begin(), newRows.end(), sortColumn(sort_lastcol_, sort_reverse_));
+
+    rows_.swap(newRows);
+    rowIndex_.swap(newIndex);
+    reindex(0, rows_.size());
+
+    selectedRow_ = -1;
+    if (!selectedId.empty())
+    {
+        selectRow(selectedId);
+    }
+
+    resizeRows();
+    redrawRows(0, rows_.size());
+}
+
+bool StringTable::rowExist(std::string const & id)
+{
+    return rowIndex_.count(id) != 0;
 }
 
 void StringTable::clear()
 {
     selectedRow_ = -1;
     rows_.clear();
+    rowIndex_.clear();
     rows(0);
 }
 
@@ -403,16 +659,9 @@ void StringTable::event_callback2()
     case CONTEXT_COL_HEADER: // someone clicked on column header
         if (Fl::event() == FL_RELEASE && Fl::event_button() == FL_LEFT_MOUSE)
         {
-            if (sort_lastcol_ == col)
-            { // Click same column? Toggle sort
-                sort_reverse_ ^= 1;
-            }
-            else
-            { // Click diff column? Up sort
-                sort_reverse_ = 0;
-            }
-            sort_column(col, sort_reverse_);
-            sort_lastcol_ = col;
+            // Click same column? Toggle sort. Click diff column? Up sort
+            int const reverse = (sort_lastcol_ == col) ? (sort_reverse_ ^ 1) : 0;
+            sort_column(col, reverse);
         }
         break;
 
@@ -468,46 +717,37 @@ void StringTable::selectRow(int rowIndex)
 
 void StringTable::selectRow(std::string const & id)
 {
-    // do nothing if selectedRow_ is correct
-    if (selectedRow_ != 0 && rows_[selectedRow_].id_ == id)
-    {
-        assert(selectedRow_ < rows());
-        return;
-    }
-
-    int row = 0;
-    for (std::vector<StringTableRow>::iterator it = rows_.begin(); it != rows_.end(); ++it)
-    {
-        if (id == it->id_)
-        {
-            selectedRow_ = row;
-            return;
-        }
-        ++row;
-    }
+    RowIndex::const_iterator it = rowIndex_.find(id);
+    selectedRow_ = (it != rowIndex_.end()) ? static_cast<int>(it->second) : -1;
+}
 
-    // row not found
-    selectedRow_ = -1;
+StringTable::SortColumn StringTable::sortColumn(int col, int reverse) const
+{
+    assert(col >= 0 && col < static_cast<int>(headers_.size()));
+    return SortColumn(col, reverse, headers_[col].numeric_);
 }
 
-StringTable::SortColumn::SortColumn(int col, int reverse)
+StringTable::SortColumn::SortColumn(int col, int reverse, bool numeric)
 {
     col_ = col;
     reverse_ = reverse;
+    numeric_ = numeric;
 }
 
-bool StringTable::SortColumn::operator()(const StringTableRow &a, const StringTableRow &b)
+bool StringTable::SortColumn::operator()(const StringTableRow &a, const StringTableRow &b) const
 {
-    int const aCols = static_cast<int>(a.data_.size());
-    int const bCols = static_cast<int>(b.data_.size());
+    if (numeric_)
+    {
+        assert(col_ < static_cast<int>(a.sortNumber_.size()) && col_ < static_cast<int>(b.sortNumber_.size()));
 
-    assert(col_ < aCols && col_ < bCols);
+        long const an = a.sortNumber_[col_];
+        long const bn = b.sortNumber_[col_];
+        return ( reverse_ ? an > bn : an < bn );
+    }
 
-    // copy since we case convert and do case-insensitive comparison
-    std::string as(a.data_[col_]);
-    std::string bs(b.data_[col_]);
-    boost::to_upper(as);
-    boost::to_upper(bs);
+    assert(col_ < static_cast<int>(a.sortText_.size()) && col_ < static_cast<int>(b.sortText_.size()));
 
+    std::string const & as = a.sortText_[col_];
+    std::string const & bs = b.sortText_[col_];
     return ( reverse_ ? as > bs : as < bs );
 }
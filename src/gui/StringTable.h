@@ -9,14 +9,17 @@
 #include <string>
 #include <vector>
 #include <array>
+#include <unordered_map>
 
 struct StringTableColumnDef
 {
     std::string name_;
     int defaultWidth_;
-    StringTableColumnDef(const std::string& name, int defaultWidth):
+    bool numeric_; // sort on leading integer of cell text
+    StringTableColumnDef(const std::string& name, int defaultWidth, bool numeric = false):
         name_(name),
-        defaultWidth_(defaultWidth)
+        defaultWidth_(defaultWidth),
+        numeric_(numeric)
     {
     }
 };
@@ -28,6 +31,10 @@ struct StringTableRow
     std::string id_;
     std::vector<std::string> data_;
 
+    // sort keys, set by StringTable when row is added or updated
+    std::vector<std::string> sortText_; // upper case data_, empty for numeric columns
+    std::vector<long> sortNumber_; // leading integer of data_ for numeric columns
+
     bool operator==(StringTableRow const & other)
     {
         return (id_ == other.id_);
@@ -61,14 +68,18 @@ public:
 
     StringTableRow const & getRow(std::size_t rowIndex);
     void addRow(StringTableRow const & row);
+    void addRows(std::vector<StringTableRow> const & rows); // sorts once, existing rows are updated
     void updateRow(StringTableRow const & row);
     void removeRow(std::string const & id);
+    void setRows(std::vector<StringTableRow> const & rows); // replace all rows, keeps selection and scroll position
     bool rowExist(std::string const & id);
     void sort();
-    void clear();
+    virtual void clear(); // overridden by tables with more row state
 
 protected:
     std::vector<StringTableRow> rows_;
+    typedef std::unordered_map<std::string, std::size_t> RowIndex;
+    RowIndex rowIndex_; // row id -> index in rows_
     int selectedRow_;
     int handle(int event);
     void selectRow(int rowIndex);
@@ -81,18 +92,30 @@ private:
     Fl_Color fltkColor(std::string const& text); // text is spring color, e.g 0xBBGGRR as int
 
     void sort_column(int col, int reverse=0);                   // sort table by a column
+    std::size_t sortedPosition(StringTableRow const & row, std::size_t first, std::size_t last); // binary search in [first,last)
+    void moveRow(std::size_t from, std::size_t to); // keeps rowIndex_ and selectedRow_ in sync
+    void reindex(std::size_t first, std::size_t last); // update rowIndex_ for rows in [first,last)
+    void resizeRows(); // sync table row count with rows_, all rows have height rowHeight_
+    void redrawRows(std::size_t first, std::size_t last); // redraw visible part of rows in [first,last) in next frame
+    void redrawPendingRows();
     void draw_sort_arrow(int X,int Y,int W,int H,int sort);
+    void makeSortKeys(StringTableRow & row);
     void savePrefs();
 
 
     struct SortColumn
     {
-        SortColumn(int col, int reverse);
-        bool operator()(const StringTableRow &a, const StringTableRow &b);
+        SortColumn(int col, int reverse, bool numeric);
+        bool operator()(const StringTableRow &a, const StringTableRow &b) const;
         int col_, reverse_;
+        bool numeric_;
     };
+    SortColumn sortColumn(int col, int reverse) const;
 
     std::vector<StringTableColumnDef> headers_;
+    int rowHeight_;
+    int pendingFirst_; // rows [pendingFirst_,pendingLast_) to redraw in next frame, empty if equal
+    int pendingLast_;
     int sort_reverse_;
     int sort_lastcol_;
     Fl_Preferences prefs_;
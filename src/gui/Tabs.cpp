@@ -234,11 +234,10 @@ int Tabs::handlePrivateChatClick(PrivateChatTab* pc)
             User const& user = model_.getUser(pc->userName()); // throws if user not online
 
             battleId = user.joinedBattle();
-            if (battleId != -1)
+            Battle const * battle = battleId != -1 ? model_.findBattle(battleId) : 0;
+            if (battle != 0)
             {
-                Battle const& battle = model_.getBattle(battleId);
-                std::string joinText = "Join " + battle.title();
-                menu.add(joinText, 3);
+                menu.add("Join " + battle->title(), 3);
             }
 
             zkAccountID = user.zkAccountID();
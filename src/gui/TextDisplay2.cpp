@@ -1,6 +1,7 @@
 // This file is part of flobby (GPL v2 or later), see the LICENSE file
 
 #include "TextDisplay2.h"
+#include "FrameScheduler.h"
 #include "PopupMenu.h"
 #include "LogFile.h"
 #include "log/Log.h"
@@ -9,7 +10,7 @@
 #include <FL/Fl.H>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
-#include <sstream>
+#include <algorithm>
 #include <cstring>
 
 
@@ -28,6 +29,7 @@ void TextDisplay2::initTextStyles()
 
 TextDisplay2::TextDisplay2(int x, int y, int w, int h, LogFile* logFile, char const * label)
     : Fl_Text_Display(x, y, w, h, label)
+    , scrollPending_(false)
     , logFile_(logFile)
 {
     textsize(12);
@@ -48,6 +50,7 @@ TextDisplay2::TextDisplay2(int x, int y, int w, int h, LogFile* logFile, char co
 
 TextDisplay2::~TextDisplay2()
 {
+    FrameScheduler::cancel(this);
 }
 
 void TextDisplay2::append(std::string const & text, int interest)
@@ -55,29 +58,24 @@ void TextDisplay2::append(std::string const & text, int interest)
     // prepends with time stamp and adds newline at end
     // interest: -2=my, -1=low, 0=normal, 1=high
 
-    // scroll to bottom if last line is visible
-    bool const scrollToBottom = !(mLastChar < text_->length());
+    // scroll to bottom if last line is visible or a scroll to bottom is already pending
+    bool const scrollToBottom = scrollPending_ || !(mLastChar < text_->length());
 
     // if string is empty we just add one empty line
     if (text.empty())
     {
         text_->append("\n");
         style_->append("\n");
+        lineLengths_.push_back(1);
     }
     else
     {
         // time stamp
         std::string const timeNow = getHourMinuteNow();
 
-        std::ostringstream oss;
-        oss << timeNow << " " << text << '\n';
-        std::string const line = oss.str();
-
-        text_->append(line.c_str());
-
-        // style for time (including trailing space)
-        std::string const styleTime(timeNow.size()+1, 'A');
-        style_->append(styleTime.c_str());
+        std::string line;
+        line.reserve(timeNow.size() + 1 + text.size() + 1);
+        line.append(timeNow).append(1, ' ').append(text).append(1, '\n');
 
         // style for rest (text + newline)
         char style;
@@ -93,24 +91,56 @@ void TextDisplay2::append(std::string const & text, int interest)
             LOG(WARNING)<< "unknown interest level "<< interest;
             break;
         }
-        std::string const styleText(text.size(), style);
-        style_->append(styleText.c_str());
-        style_->append("\n");
+
+        // style for time (including trailing space), text and newline, built in one go
+        std::string styleLine(line.size(), style);
+        std::fill(styleLine.begin(), styleLine.begin() + timeNow.size() + 1, 'A');
+        styleLine.back() = '\n';
+
+        text_->append(line.c_str());
+        style_->append(styleLine.c_str());
+        lineLengths_.push_back(static_cast<int>(line.size()));
     }
 
     // limit text buffer size, raise limit if we are scrolled up
-    int const maxLength = 20000*(scrollToBottom ? 1 : 10);
-    while (text_->length() > maxLength)
+    trim(20000*(scrollToBottom ? 1 : 10));
+
+    if (scrollToBottom && !scrollPending_)
     {
-        int const posNewline = text_->line_end(0);
-        text_->remove(0, posNewline+1);
-        style_->remove(0, posNewline+1);
+        scrollPending_ = true;
+        FrameScheduler::update(this, [this]() {
+            scrollPending_ = false;
+            scroll(text_->length(), 0);
+        });
     }
+}
 
-    if (scrollToBottom)
+void TextDisplay2::trim(int maxLength)
+{
+    // removing from the head of Fl_Text_Buffer moves the whole buffer,
+    // so let it grow a quarter above the limit and remove many lines at once
+    int const length = text_->length();
+    if (length <= maxLength + maxLength/4)
+    {
+        return;
+    }
+
+    int removeLength = 0;
+    while (!lineLengths_.empty() && length - removeLength > maxLength)
     {
-        scroll(text_->length(), 0);
+        removeLength += lineLengths_.front();
+        lineLengths_.pop_front();
     }
+
+    text_->remove(0, removeLength);
+    style_->remove(0, removeLength);
+}
+
+void TextDisplay2::clearText()
+{
+    text_->remove(0, text_->length());
+    style_->remove(0, style_->length());
+    lineLengths_.clear();
 }
 
 int TextDisplay2::handle(int event)
@@ -164,8 +194,7 @@ int TextDisplay2::handle(int event)
             switch (id)
             {
             case 1:
-                text_->remove(0, text_->length());
-                style_->remove(0, style_->length());
+                clearText();
                 return 1;
             case 2:
                 LogFile::openLogFile(logFile_->path());
@@ -4,6 +4,7 @@
 
 #include <FL/Fl_Text_Display.H>
 #include <string>
+#include <deque>
 
 class LogFile;
 class Fl_Text_Buffer;
@@ -30,9 +31,13 @@ public:
 private:
     Fl_Text_Buffer * text_;
     Fl_Text_Buffer * style_;
+    std::deque<int> lineLengths_; // length of each appended line in text_, including newline, oldest first
+    bool scrollPending_; // scroll to bottom in next frame
 
     LogFile* logFile_;
 
     int handle(int event);
+    void trim(int maxLength);
+    void clearText();
 
 };
@@ -0,0 +1,468 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#include "ThumbnailAtlas.h"
+
+#include "log/Log.h"
+
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// File layout: FileHeader followed by records of RecordHeader, key and pixels. Records are only
+// appended, a later record replaces an earlier one with the same key, a record without pixels
+// removes it. Loading reads the record headers only, the checksum of an image is verified when
+// it is mapped. A damaged end, e.g. after a crash while appending, or many replaced and removed
+// records make the file be rewritten when opening. The live records are written to a new file
+// that replaces the old one, so other flobbies keep their images in the old one and a crash
+// leaves either of them. For the same reason <path>.lock is locked instead of the file.
+//
+// The file is mapped from the start with room to grow, pages beyond the end of the file are not
+// accessed. When it outgrows the mapping, a new mapping of twice the size is added, the old ones
+// are kept for the images pointing into them. This keeps the number of mappings logarithmic in
+// the file size.
+
+namespace
+{
+    char const FileMagic[8] = { 'f', 'l', 'o', 'b', 'b', 'y', 'T', 'A' };
+    uint32_t const FileVersion = 2;
+    uint32_t const RecordMagic = 0x7448626d;
+    uint64_t const MinMapSize = 16*1024*1024;
+
+    // compact when more than a quarter of the file is replaced or removed records
+    uint64_t const CompactMinDeadBytes = 1024*1024;
+
+    struct FileHeader
+    {
+        char magic_[8];
+        uint32_t version_;
+        uint32_t reserved_;
+    };
+
+    struct RecordHeader
+    {
+        uint32_t magic_;
+        uint16_t keySize_;
+        uint16_t w_;
+        uint16_t h_;
+        uint16_t d_;
+        uint32_t crc_; // of key and pixels
+    };
+
+    uint32_t crc(std::string const& key, uint8_t const* pixels, std::size_t size)
+    {
+        boost::crc_32_type crc;
+        crc.process_bytes(key.data(), key.size());
+        crc.process_bytes(pixels, size);
+        return crc.checksum();
+    }
+
+    uint64_t pixelsSize(int w, int h, int d)
+    {
+        return static_cast<uint64_t>(w)*h*d;
+    }
+
+    uint64_t recordSize(std::string const& key, int w, int h, int d)
+    {
+        return sizeof(RecordHeader) + key.size() + pixelsSize(w, h, d);
+    }
+
+    std::vector<uint8_t> encodeRecord(std::string const& key, uint8_t const* data, int w, int h, int d)
+    {
+        std::size_t const pixels = pixelsSize(w, h, d);
+        RecordHeader const header = { RecordMagic, static_cast<uint16_t>(key.size()),
+                                      static_cast<uint16_t>(w), static_cast<uint16_t>(h), static_cast<uint16_t>(d),
+                                      crc(key, data, pixels) };
+        std::vector<uint8_t> buffer(sizeof(header) + key.size() + pixels);
+        std::memcpy(&buffer[0], &header, sizeof(header));
+        std::memcpy(&buffer[sizeof(header)], key.data(), key.size());
+        if (pixels > 0)
+        {
+            std::memcpy(&buffer[sizeof(header) + key.size()], data, pixels);
+        }
+        return buffer;
+    }
+
+    void writeAll(int fd, uint8_t const* data, std::size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            ssize_t const n = ::pwrite(fd, data, size, offset);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("pwrite failed: ") + std::strerror(errno));
+            }
+            data += n;
+            size -= n;
+            offset += n;
+        }
+    }
+}
+
+ThumbnailAtlas::ThumbnailAtlas(std::string const & path):
+    path_(path),
+    lockFd_(-1),
+    fd_(-1),
+    writable_(false),
+    fileSize_(0),
+    deadBytes_(0)
+{
+    try
+    {
+        open();
+    }
+    catch (std::exception const & e)
+    {
+        LOG(WARNING) << "thumbnail file " << path_ << " not used: " << e.what();
+        entries_.clear();
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        if (lockFd_ >= 0)
+        {
+            ::close(lockFd_);
+            lockFd_ = -1;
+        }
+        writable_ = false;
+    }
+}
+
+ThumbnailAtlas::~ThumbnailAtlas()
+{
+    for (Mapping const & mapping : mappings_)
+    {
+        ::munmap(mapping.addr_, mapping.size_);
+    }
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+    if (lockFd_ >= 0)
+    {
+        ::close(lockFd_); // releases the lock
+    }
+}
+
+void ThumbnailAtlas::open()
+{
+    std::string const lockPath = path_ + ".lock";
+    lockFd_ = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd_ < 0)
+    {
+        throw std::runtime_error("open failed: " + lockPath + ": " + std::strerror(errno));
+    }
+
+    writable_ = ::flock(lockFd_, LOCK_EX | LOCK_NB) == 0;
+    if (!writable_)
+    {
+        LOG(WARNING) << path_ << " is used by another flobby, new thumbnails are not saved";
+    }
+
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error(std::string("open failed: ") + std::strerror(errno));
+    }
+
+    bool const clean = load();
+
+    if (writable_ && (!clean || (deadBytes_ >= CompactMinDeadBytes && deadBytes_ > fileSize_/4)))
+    {
+        rewrite();
+    }
+}
+
+bool ThumbnailAtlas::load()
+{
+    struct stat st;
+    if (::fstat(fd_, &st) != 0)
+    {
+        throw std::runtime_error(std::string("fstat failed: ") + std::strerror(errno));
+    }
+    uint64_t const size = st.st_size;
+
+    FileHeader header;
+    fileSize_ = sizeof(header);
+    if (size < sizeof(header) || ::pread(fd_, &header, sizeof(header), 0) != sizeof(header) ||
+        std::memcmp(header.magic_, FileMagic, sizeof(FileMagic)) != 0 || header.version_ != FileVersion)
+    {
+        if (size > 0)
+        {
+            LOG(INFO) << "unknown thumbnail file format, recreating " << path_;
+        }
+        return false;
+    }
+
+    if (size == fileSize_) return true;
+
+    uint8_t const* const base = map(size);
+
+    uint64_t offset = sizeof(header);
+    while (offset + sizeof(RecordHeader) <= size)
+    {
+        RecordHeader record;
+        std::memcpy(&record, base + offset, sizeof(record));
+
+        bool const removal = record.w_ == 0 && record.h_ == 0 && record.d_ == 0;
+        uint64_t const pixels = offset + sizeof(record) + record.keySize_;
+        uint64_t const end = pixels + pixelsSize(record.w_, record.h_, record.d_);
+        if (record.magic_ != RecordMagic || end > size ||
+            (!removal && (record.w_ == 0 || record.h_ == 0 || (record.d_ != 1 && record.d_ != 3))))
+        {
+            break;
+        }
+
+        std::string const key(reinterpret_cast<char const*>(base + offset + sizeof(record)), record.keySize_);
+        if (removal && crc(key, 0, 0) != record.crc_)
+        {
+            break;
+        }
+
+        auto it = entries_.find(key);
+        if (it != entries_.end())
+        {
+            Image const & image = it->second.image_;
+            deadBytes_ += recordSize(key, image.w_, image.h_, image.d_);
+        }
+        if (removal)
+        {
+            deadBytes_ += end - offset;
+            if (it != entries_.end()) entries_.erase(it);
+        }
+        else
+        {
+            // checked and mapped when needed
+            entries_[key] = Entry{pixels, record.crc_, false, Image{0, record.w_, record.h_, record.d_}};
+        }
+        offset = end;
+    }
+    fileSize_ = offset;
+    LOG(INFO) << "loaded " << entries_.size() << " thumbnails from " << path_;
+
+    if (offset < size)
+    {
+        LOG(WARNING) << "dropping damaged end of " << path_ << " at " << offset << " of " << size << " bytes";
+        return false;
+    }
+    return true;
+}
+
+void ThumbnailAtlas::rewrite()
+{
+    // copied in file order for sequential reads
+    typedef std::pair<std::string const, Entry> Pair;
+    std::vector<std::pair<uint64_t, Pair*>> records;
+    for (Pair & pair : entries_)
+    {
+        assert(pair.second.image_.data_ == 0);
+        records.emplace_back(pair.second.offset_ - pair.first.size() - sizeof(RecordHeader), &pair);
+    }
+    std::sort(records.begin(), records.end());
+
+    uint8_t const* const base = records.empty() ? 0 : map(fileSize_);
+
+    std::string const tmpPath = path_ + ".tmp";
+    int const fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("open failed: " + tmpPath + ": " + std::strerror(errno));
+    }
+
+    std::vector<uint64_t> offsets; // of the pixels in the new file
+    uint64_t offset = 0;
+    try
+    {
+        FileHeader header;
+        std::memcpy(header.magic_, FileMagic, sizeof(FileMagic));
+        header.version_ = FileVersion;
+        header.reserved_ = 0;
+        writeAll(fd, reinterpret_cast<uint8_t const*>(&header), sizeof(header), 0);
+        offset = sizeof(header);
+
+        for (auto const & record : records)
+        {
+            std::string const & key = record.second->first;
+            Image const & image = record.second->second.image_;
+            uint64_t const size = recordSize(key, image.w_, image.h_, image.d_);
+            writeAll(fd, base + record.first, size, offset);
+            offsets.push_back(offset + sizeof(RecordHeader) + key.size());
+            offset += size;
+        }
+
+        // the new file must be complete before it replaces the old one
+        if (::fdatasync(fd) != 0)
+        {
+            throw std::runtime_error(std::string("fdatasync failed: ") + std::strerror(errno));
+        }
+        if (::rename(tmpPath.c_str(), path_.c_str()) != 0)
+        {
+            throw std::runtime_error(std::string("rename failed: ") + std::strerror(errno));
+        }
+    }
+    catch (std::exception const &)
+    {
+        ::close(fd);
+        std::remove(tmpPath.c_str());
+        throw;
+    }
+
+    // no image points into the mappings of the old file yet
+    for (Mapping const & mapping : mappings_)
+    {
+        ::munmap(mapping.addr_, mapping.size_);
+    }
+    mappings_.clear();
+    ::close(fd_);
+    fd_ = fd;
+
+    for (std::size_t i = 0; i < records.size(); ++i)
+    {
+        records[i].second->second.offset_ = offsets[i];
+    }
+
+    LOG(INFO) << "rewrote " << path_ << " from " << fileSize_ << " to " << offset << " bytes";
+    fileSize_ = offset;
+    deadBytes_ = 0;
+}
+
+bool ThumbnailAtlas::has(std::string const & key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.count(key) != 0;
+}
+
+bool ThumbnailAtlas::get(std::string const & key, Image & image)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return false;
+
+    Entry & entry = it->second;
+    if (entry.image_.data_ == 0)
+    {
+        uint64_t const size = pixelsSize(entry.image_.w_, entry.image_.h_, entry.image_.d_);
+        uint8_t const* const data = map(entry.offset_ + size) + entry.offset_;
+        if (!entry.checked_ && crc(key, data, size) != entry.crc_)
+        {
+            LOG(WARNING) << "dropping damaged thumbnail " << key << " in " << path_;
+            deadBytes_ += recordSize(key, entry.image_.w_, entry.image_.h_, entry.image_.d_);
+            entries_.erase(it);
+            return false;
+        }
+        entry.checked_ = true;
+        entry.image_.data_ = data;
+    }
+    image = entry.image_;
+    return true;
+}
+
+void ThumbnailAtlas::add(std::string const & key, uint8_t const* data, int w, int h, int d)
+{
+    assert(w > 0 && w <= 0xffff && h > 0 && h <= 0xffff && (d == 1 || d == 3) && key.size() <= 0xffff);
+    std::size_t const pixels = pixelsSize(w, h, d);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (writable_)
+    {
+        std::vector<uint8_t> const buffer = encodeRecord(key, data, w, h, d);
+        uint64_t const offset = append(key, buffer) + sizeof(RecordHeader) + key.size();
+        entries_[key] = Entry{offset, 0, true, Image{0, w, h, d}}; // mapped when needed
+    }
+    else
+    {
+        memory_.emplace_back(new uint8_t[pixels]);
+        std::memcpy(memory_.back().get(), data, pixels);
+        entries_[key] = Entry{0, 0, true, Image{memory_.back().get(), w, h, d}};
+    }
+}
+
+void ThumbnailAtlas::remove(std::string const & key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return;
+
+    if (writable_)
+    {
+        std::vector<uint8_t> const buffer = encodeRecord(key, 0, 0, 0, 0);
+        append(key, buffer);
+        Image const & image = it->second.image_;
+        deadBytes_ += recordSize(key, image.w_, image.h_, image.d_) + buffer.size();
+    }
+    entries_.erase(it); // the pixels stay mapped for images still using them
+}
+
+std::vector<std::string> ThumbnailAtlas::keys()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::string> keys;
+    keys.reserve(entries_.size());
+    for (auto const & pair : entries_)
+    {
+        keys.push_back(pair.first);
+    }
+    return keys;
+}
+
+uint64_t ThumbnailAtlas::append(std::string const & key, std::vector<uint8_t> const & buffer)
+{
+    try
+    {
+        writeAll(fd_, buffer.data(), buffer.size(), fileSize_);
+    }
+    catch (std::exception const & e)
+    {
+        // drop the partial record so the next one starts at a record boundary
+        if (::ftruncate(fd_, fileSize_) != 0) writable_ = false;
+        throw std::runtime_error("failed to write " + key + " to " + path_ + ": " + e.what());
+    }
+
+    uint64_t const offset = fileSize_;
+    fileSize_ += buffer.size();
+    return offset;
+}
+
+std::size_t ThumbnailAtlas::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+uint8_t const* ThumbnailAtlas::map(uint64_t end)
+{
+    if (!mappings_.empty() && end <= mappings_.back().size_)
+    {
+        return mappings_.back().addr_;
+    }
+
+    uint64_t const page = ::sysconf(_SC_PAGESIZE);
+    uint64_t size = std::max(end, MinMapSize);
+    if (!mappings_.empty())
+    {
+        size = std::max(size, 2*mappings_.back().size_);
+    }
+    size = (size + page - 1)/page*page;
+
+    void * const addr = ::mmap(0, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED)
+    {
+        throw std::runtime_error("mmap failed: " + path_ + ": " + std::strerror(errno));
+    }
+    mappings_.push_back(Mapping{static_cast<uint8_t*>(addr), size});
+    return mappings_.back().addr_;
+}
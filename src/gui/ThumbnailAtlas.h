@@ -0,0 +1,69 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// single file holding map cache thumbnails as raw pixels, new thumbnails are appended and
+// the file is memory mapped for reading, all methods are thread safe
+class ThumbnailAtlas
+{
+public:
+    // thumbnails are only kept in memory if the file can't be opened or is used by another flobby,
+    // rewrites the file if it has many replaced or removed thumbnails
+    ThumbnailAtlas(std::string const& path);
+    virtual ~ThumbnailAtlas();
+
+    struct Image
+    {
+        uint8_t const* data_; // w_*h_*d_ bytes, rows are not padded, valid while the atlas exists
+        int w_;
+        int h_;
+        int d_;
+    };
+
+    bool has(std::string const& key);
+    bool get(std::string const& key, Image & image); // returns false if not found or damaged, throws if mapping fails
+    void add(std::string const& key, uint8_t const* data, int w, int h, int d); // replaces an existing image, throws on write error
+    void remove(std::string const& key); // images already returned stay valid, throws on write error
+    std::vector<std::string> keys();
+    std::size_t size(); // number of images
+
+private:
+    struct Entry
+    {
+        uint64_t offset_; // of the pixels in the file
+        uint32_t crc_; // of key and pixels, from the file
+        bool checked_; // crc_ matches, not checked when loading to avoid reading all pixels
+        Image image_; // data_ is 0 until mapped
+    };
+
+    struct Mapping
+    {
+        uint8_t* addr_; // of file offset 0
+        uint64_t size_; // can be beyond the end of the file
+    };
+
+    std::mutex mutex_;
+    std::string const path_;
+    int lockFd_; // of <path>.lock, -1 if not open
+    int fd_; // -1 if not open
+    bool writable_; // holding the lock
+    uint64_t fileSize_; // end of the last valid record
+    uint64_t deadBytes_; // of replaced and removed records
+    std::unordered_map<std::string, Entry> entries_;
+    std::vector<Mapping> mappings_; // growing, not unmapped before destruction since images point into them
+    std::vector<std::unique_ptr<uint8_t[]>> memory_; // images not in the file
+
+    void open();
+    bool load(); // returns false if the file is unknown or has a damaged end
+    void rewrite(); // replaces the file by one with the records of entries_ only, no image may be mapped yet
+    uint64_t append(std::string const& key, std::vector<uint8_t> const& record); // returns the offset of the record, throws on error
+    uint8_t const* map(uint64_t end); // returns the start of a mapping covering offsets up to end
+};
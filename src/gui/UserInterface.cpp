@@ -23,6 +23,8 @@
 #include "FontSettingsDialog.h"
 #include "DownloadSettingsDialog.h"
 #include "OpenBattleZkDialog.h"
+#include "FrameScheduler.h"
+#include "MapCachePool.h"
 
 #include "log/Log.h"
 #include "model/Model.h"
@@ -48,6 +50,8 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <stdexcept>
 #include <cassert>
 
 // Prefs
@@ -58,6 +62,7 @@ static char const * PrefAppWindowH = "AppWindowH";
 static char const * PrefAppWindowSplitH = "AppWindowSplitH";
 static char const * PrefLeftSplitV = "LeftSplitV";
 static char const * PrefAutoJoinChannels = "AutoJoinChannels";
+static char const * PrefFramesPerSecond = "FramesPerSecond";
 
 
 static XScreenSaverInfo* xScreenSaverInfo = 0;
@@ -67,7 +72,8 @@ UserInterface::UserInterface(Model & model) :
     model_(model),
     cache_(new Cache(model_)),
     genJobsCount_(0),
-    openMapsWindow_(false)
+    genJobsDone_(0),
+    mapCachePool_(new MapCachePool(*this, *cache_, genImageDone, this))
 {
     TextDisplay2::initTextStyles();
 
@@ -153,7 +159,7 @@ UserInterface::UserInterface(Model & model) :
 
     progressDialog_ = new ProgressDialog();
     channelsWindow_ = new ChannelsWindow(model_);
-    mapsWindow_ = new MapsWindow(model_, *cache_);
+    mapsWindow_ = new MapsWindow(*this, model_, *cache_);
 
     loginDialog_ = new LoginDialog(model_);
     registerDialog_ = new RegisterDialog(model_);
@@ -183,6 +189,9 @@ UserInterface::UserInterface(Model & model) :
 
 UserInterface::~UserInterface()
 {
+    mapCachePool_.reset();
+    cache_->removeUnusedImages();
+
     prefs().set(PrefAppWindowX, mainWindow_->x_root());
     prefs().set(PrefAppWindowY, mainWindow_->y_root());
     prefs().set(PrefAppWindowW, mainWindow_->w());
@@ -198,6 +207,7 @@ UserInterface::~UserInterface()
 
     model_.disconnect();
 
+    LogFile::shutdown();
     prefs().flush();
 }
 
@@ -207,6 +217,10 @@ void UserInterface::setupEarlySettings()
     initPrefs();
     setupLogging();
     FontSettingsDialog::setupFont();
+
+    int fps;
+    prefs().get(PrefFramesPerSecond, fps, FrameScheduler::MaxFramesPerSecond);
+    FrameScheduler::framesPerSecond(fps);
 }
 
 void UserInterface::setupLogging()
@@ -218,8 +232,25 @@ void UserInterface::setupLogging()
     {
         Log::minSeverity(DEBUG);
     }
+    int logMaxSize, logMaxAge, logKeepFiles, logCompress;
+    prefs().get(PrefLogMaxSize, logMaxSize, 10);
+    prefs().get(PrefLogMaxAge, logMaxAge, 0);
+    prefs().get(PrefLogKeepFiles, logKeepFiles, 5);
+    prefs().get(PrefLogCompress, logCompress, 0);
+    Log::rotation(std::max(logMaxSize, 0)*1024*1024, std::max(logMaxAge, 0)*3600, logKeepFiles, logCompress != 0);
     Log::logFile(cacheDir()+"flobby.log");
 
+    char logModules[1024];
+    prefs().get(PrefLogModules, logModules, "", sizeof(logModules));
+    try
+    {
+        Log::moduleSeverities(logModules);
+    }
+    catch (std::invalid_argument const & e)
+    {
+        LOG(WARNING) << "ignoring " << PrefLogModules << ": " << e.what();
+    }
+
     int logChats;
     prefs().get(PrefLogChats, logChats, 1);
     LogFile::enable(logChats == 1 ? true : false);
@@ -488,7 +519,7 @@ void UserInterface::menuGenerateCacheFiles(Fl_Widget *w, void* d)
 {
     UserInterface * ui = static_cast<UserInterface*>(d);
 
-    if (!ui->genJobs_.empty())
+    if (ui->genJobsCount_ != 0 || ui->mapCachePool_->pending() != 0)
     {
         LOG(WARNING)<< "map generate job already in progress";
         return;
@@ -505,6 +536,7 @@ void UserInterface::menuGenerateCacheFiles(Fl_Widget *w, void* d)
         if (!ui->cache_->hasHeightImage(map)) ui->genJobs_.push_back(GenJob(map, GEN_HEIGHT));
     }
     ui->genJobsCount_ = ui->genJobs_.size();
+    ui->genJobsDone_ = 0;
 
     Fl::add_timeout(0, doGenJob, ui);
 }
@@ -513,30 +545,8 @@ void UserInterface::menuMaps(Fl_Widget *w, void* d)
 {
     UserInterface * ui = static_cast<UserInterface*>(d);
 
-    if (!ui->genJobs_.empty())
-    {
-        LOG(WARNING)<< "map generate job already in progress";
-        return;
-    }
-
-    auto maps = ui->model_.getMaps();
-    for (auto const& map : maps)
-    {
-        if (!ui->cache_->hasMapImage(map)) ui->genJobs_.push_back(GenJob(map, GEN_MAP));
-    }
-
-    if (!ui->genJobs_.empty())
-    {
-        ProgressDialog::open("Generating map images ...");
-
-        ui->genJobsCount_ = ui->genJobs_.size();
-        Fl::add_timeout(0, doGenJob, ui);
-        ui->openMapsWindow_ = true;
-    }
-    else
-    {
-        ui->mapsWindow_->show();
-    }
+    // missing images are generated by the window
+    ui->mapsWindow_->show();
 }
 
 void UserInterface::menuOpenBattleZk(Fl_Widget *w, void* d)
@@ -756,41 +766,25 @@ void UserInterface::closeProgressDialog(void* d)
 
 void UserInterface::doGenJob(void* d)
 {
+    // unitsync is not thread safe, map data is extracted here on the UI thread one job at a time,
+    // the images are scaled and added to the cache by mapCachePool_
     UserInterface* ui = static_cast<UserInterface*>(d);
 
-    if (!ProgressDialog::isVisible())
-    {
-        // canceled by user
-        ui->genJobs_.clear();
-        ProgressDialog::close();
-        ui->openMapsWindow_ = false;
-    }
-    else if (ui->genJobs_.empty())
-    {
-        if (ui->openMapsWindow_)
-        {
-            ProgressDialog::close();
-            ui->mapsWindow_->show();
-            ui->openMapsWindow_ = false;
-        }
-        else
-        {
-            // show Done for a short time
-            ProgressDialog::progress(100, "Done");
-            Fl::add_timeout(0.5, closeProgressDialog, d);
-        }
-    }
-    else
+    if (ui->genJobsCount_ == 0) return; // done or canceled
+
+    // limit the extracted images waiting in memory
+    if (ProgressDialog::isVisible() && !ui->genJobs_.empty() && ui->mapCachePool_->pending() < 2*ui->mapCachePool_->threads())
     {
-        float const percentage = 100*static_cast<float>(ui->genJobsCount_ - ui->genJobs_.size())/ui->genJobsCount_;
         GenJob const job = ui->genJobs_.front();
-        ui->genJobs_.pop_front();
-        ProgressDialog::progress(percentage, job.name_);
+        ProgressDialog::progress(100*static_cast<float>(ui->genJobsDone_)/ui->genJobsCount_, job.name_);
         Fl::check();
+        if (ui->genJobsCount_ == 0) return; // canceled during check
+        ui->genJobs_.pop_front();
 
+        bool queued = false;
         try
         {
-            Fl_Shared_Image * img;
+            Cache::ImageFile imageFile;
             switch (job.type_)
             {
             case GEN_INFO:
@@ -798,27 +792,79 @@ void UserInterface::doGenJob(void* d)
                 break;
 
             case GEN_MAP:
-                img = ui->cache_->getMapImage(job.name_);
-                if (img) img->release();
+                queued = ui->cache_->extractMapImage(job.name_, imageFile);
                 break;
 
             case GEN_METAL:
-                img = ui->cache_->getMetalImage(job.name_);
-                if (img) img->release();
+                queued = ui->cache_->extractMetalImage(job.name_, imageFile);
                 break;
 
             case GEN_HEIGHT:
-                img = ui->cache_->getHeightImage(job.name_);
-                if (img) img->release();
+                queued = ui->cache_->extractHeightImage(job.name_, imageFile);
                 break;
             }
+            if (queued)
+            {
+                ui->mapCachePool_->add(std::move(imageFile));
+            }
         }
         catch (std::exception const & e)
         {
             LOG(WARNING) << e.what();
         }
 
-        Fl::add_timeout(0.01, doGenJob, d);
+        if (!queued)
+        {
+            ++ui->genJobsDone_;
+        }
+
+        if (!ui->genJobs_.empty() && !Fl::has_timeout(doGenJob, d))
+        {
+            Fl::add_timeout(0.01, doGenJob, d);
+        }
+    }
+
+    ui->genJobsProgress();
+}
+
+void UserInterface::genImageDone(void* d)
+{
+    UserInterface* ui = static_cast<UserInterface*>(d);
+
+    if (ui->genJobsCount_ == 0) return; // canceled
+
+    ++ui->genJobsDone_;
+    if (!ui->genJobs_.empty() && !Fl::has_timeout(doGenJob, d))
+    {
+        // the pool has room for another image
+        Fl::add_timeout(0, doGenJob, d);
+    }
+    ui->genJobsProgress();
+}
+
+void UserInterface::genJobsProgress()
+{
+    if (genJobsCount_ == 0) return;
+
+    if (!ProgressDialog::isVisible())
+    {
+        // canceled by user, files already being written are finished in the background
+        genJobs_.clear();
+        mapCachePool_->clear();
+        genJobsCount_ = 0;
+        ProgressDialog::close();
+    }
+    else if (genJobs_.empty() && mapCachePool_->pending() == 0)
+    {
+        genJobsCount_ = 0;
+
+        // show Done for a short time
+        ProgressDialog::progress(100, "Done");
+        Fl::add_timeout(0.5, closeProgressDialog, this);
+    }
+    else if (genJobs_.empty())
+    {
+        ProgressDialog::progress(100*static_cast<float>(genJobsDone_)/genJobsCount_, "Writing images ...");
     }
 }
 
@@ -11,6 +11,7 @@
 // forwards
 class Model;
 class Cache;
+class MapCachePool;
 class Battle;
 class User;
 class SpringDialog;
@@ -72,8 +73,9 @@ private:
         GenJob(std::string const& name, GenType type): name_(name), type_(type) {}
     };
     std::deque<GenJob> genJobs_;
-    std::size_t genJobsCount_;
-    bool openMapsWindow_; // used for showing maps windows after map image files generation is done
+    std::size_t genJobsCount_; // zero when not generating
+    std::size_t genJobsDone_;
+    std::unique_ptr<MapCachePool> mapCachePool_; // writes the images
 
     Fl_Double_Window * mainWindow_;
     std::string startTitle_;
@@ -139,6 +141,8 @@ private:
     static void menuFontSettings(Fl_Widget *w, void* d);
     static void checkAway(void* d);
     static void doGenJob(void* d);
+    static void genImageDone(void* d);
+    void genJobsProgress();
     static void closeProgressDialog(void* d);
     static void quitHandler(void* d);
     static void menuOpenBattleZk(Fl_Widget *w, void* d);
@@ -11,6 +11,12 @@
 #include <FL/Fl.H>
 #include "FL/fl_ask.H"
 #include <boost/bind.hpp>
+#include <cassert>
+
+UserList::Index UserList::index_;
+int UserList::instances_ = 0;
+SignalConnection UserList::userChangedConnection_;
+SignalConnection UserList::battleClosedConnection_;
 
 UserList::UserList(int x, int y, int w, int h, Model & model, ITabs & iTabs, bool savePrefs):
     StringTable(x, y, w, h, "UserList", { {"name",10}, {"status",4} }, 0 /* sort on name by default */, savePrefs),
@@ -20,12 +26,28 @@ UserList::UserList(int x, int y, int w, int h, Model & model, ITabs & iTabs, boo
     connectRowClicked( boost::bind(&UserList::userClicked, this, _1, _2) );
     connectRowDoubleClicked( boost::bind(&UserList::userDoubleClicked, this, _1, _2) );
 
-    model_.connectUserChanged( boost::bind(&UserList::userChanged, this, _1) );
+    if (instances_++ == 0)
+    {
+        userChangedConnection_ = model_.connectUserChanged( boost::bind(&UserList::userChangedAll, _1) );
+        battleClosedConnection_ = model_.connectBattleClosed( boost::bind(&UserList::battleClosedAll, _1, _2) );
+    }
+}
+
+UserList::~UserList()
+{
+    clear();
+
+    if (--instances_ == 0)
+    {
+        userChangedConnection_.disconnect();
+        battleClosedConnection_.disconnect();
+    }
 }
 
 void UserList::add(User const & user)
 {
     addRow(makeRow(user));
+    indexAdd(user.name());
 }
 
 void UserList::add(std::string const & userName)
@@ -34,9 +56,62 @@ void UserList::add(std::string const & userName)
     add(user);
 }
 
+void UserList::add(std::vector<std::string> const & userNames)
+{
+    std::vector<StringTableRow> rows;
+    rows.reserve(userNames.size());
+
+    for (std::string const & userName : userNames)
+    {
+        // skip non-existing user (uberserver bug) to not skip the rest of users
+        if (User const * user = model_.findUser(userName))
+        {
+            rows.push_back(makeRow(*user));
+        }
+        else
+        {
+            LOG(WARNING)<< "user not found:" << userName;
+        }
+    }
+    addRows(rows);
+
+    for (StringTableRow const & row : rows)
+    {
+        indexAdd(row.id_);
+    }
+}
+
 void UserList::remove(std::string const & userName)
 {
     removeRow(userName);
+    indexRemove(userName);
+}
+
+void UserList::clear()
+{
+    for (StringTableRow const & row : rows_)
+    {
+        indexRemove(row.id_);
+    }
+    StringTable::clear();
+}
+
+void UserList::indexAdd(std::string const & userName)
+{
+    index_[userName].insert(this);
+}
+
+void UserList::indexRemove(std::string const & userName)
+{
+    Index::iterator it = index_.find(userName);
+    if (it != index_.end())
+    {
+        it->second.erase(this);
+        if (it->second.empty())
+        {
+            index_.erase(it);
+        }
+    }
 }
 
 StringTableRow UserList::makeRow(User const & user)
@@ -60,13 +135,27 @@ std::string UserList::statusString(User const & user)
 
 void UserList::userChanged(User const & user)
 {
-    try
+    updateRow(makeRow(user));
+}
+
+void UserList::userChangedAll(User const & user)
+{
+    Index::const_iterator it = index_.find(user.name());
+    if (it != index_.end())
     {
-        updateRow(makeRow(user)); // throws if row not found
+        for (UserList * userList : it->second)
+        {
+            userList->userChanged(user);
+        }
     }
-    catch (std::runtime_error & e)
+}
+
+void UserList::battleClosedAll(Battle const & battle, Battle::BattleUsers const & leftUsers)
+{
+    for (Battle::BattleUsers::value_type const & pair : leftUsers)
     {
-        // ignore
+        assert(pair.second);
+        userChangedAll(*pair.second);
     }
 }
 
@@ -98,15 +187,14 @@ void UserList::userClicked(int rowIndex, int button)
 
         if (battleId != -1)
         {
-            try
+            Battle const * battle = model_.findBattle(battleId);
+            if (battle != 0)
             {
-                Battle const& battle = model_.getBattle(battleId);
-                std::string joinText = "Join " + battle.title();
-                menu.add(joinText, 3);
+                menu.add("Join " + battle->title(), 3);
             }
-            catch (std::invalid_argument const& e)
+            else
             {
-                LOG(WARNING) << e.what();
+                LOG(WARNING) << "battle not found:" << battleId;
             }
         }
 
@@ -189,14 +277,13 @@ std::string UserList::completeUserName(std::string const& text, std::string cons
     for (int i=0; i<rows(); ++i)
     {
         StringTableRow const & row = getRow(static_cast<std::size_t>(i));
-        try
+        if (model_.findUser(row.data_[0]))
         {
-            User const & user = model_.getUser(row.data_[0]);
             userNames.push_back(row.data_[0]);
         }
-        catch (std::invalid_argument const & e)
+        else
         {
-            LOG(WARNING)<< "unexpected exception: "<< e.what();
+            LOG(WARNING)<< "user not found:" << row.data_[0];
         }
     }
 
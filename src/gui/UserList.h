@@ -3,8 +3,13 @@
 #pragma once
 
 #include "StringTable.h"
+#include "model/Battle.h"
+#include "model/Signal.h"
 
 #include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
 
 class Model;
 class ITabs;
@@ -14,10 +19,13 @@ class UserList: public StringTable
 {
 public:
     UserList(int x, int y, int w, int h, Model & model, ITabs & iTabs, bool savePrefs = false);
+    virtual ~UserList();
 
     void add(User const & user);
     void add(std::string const & userName);
+    void add(std::vector<std::string> const & userNames); // ignores unknown users
     void remove(std::string const & userName);
+    void clear() override;
 
     std::string completeUserName(std::string const& text, std::string const& ignore);
 
@@ -25,6 +33,16 @@ private:
     Model & model_;
     ITabs & iTabs_;
 
+    // user name -> lists showing the user, shared by all lists so a user change only updates the lists showing the user
+    typedef std::unordered_map<std::string, std::set<UserList*>> Index;
+    static Index index_;
+    static int instances_;
+    static SignalConnection userChangedConnection_;
+    static SignalConnection battleClosedConnection_;
+
+    void indexAdd(std::string const & userName);
+    void indexRemove(std::string const & userName);
+
     StringTableRow makeRow(User const & user);
     std::string statusString(User const & user);
 
@@ -32,6 +50,9 @@ private:
     void userClicked(int rowIndex, int button);
     void userDoubleClicked(int rowIndex, int button);
 
-    // model signals
     void userChanged(User const & user);
+
+    // model signals, connected once for all lists
+    static void userChangedAll(User const & user);
+    static void battleClosedAll(Battle const & battle, Battle::BattleUsers const & leftUsers);
 };
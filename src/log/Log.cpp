@@ -3,8 +3,24 @@
 #include "Log.h"
 
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <cctype>
+#include <algorithm>
+#include <utility>
 #include <cstring>
+#include <cstdio>
+#include <exception>
+#include <csignal>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 std::ostringstream Log::earlyLogs_;
 std::ofstream Log::ofs_;
@@ -13,30 +29,317 @@ Log::Severity Log::minSev_ = Log::Info;
 
 static std::mutex m;
 
+struct Log::Record
+{
+    Record(): next_(nullptr), sev_(Log::Debug), loc_(""), line_(0), time_(0) {}
+    Record(Log & log):
+        next_(nullptr), sev_(log.sev_), loc_(log.loc_), line_(log.line_), time_(log.time_), when_(log.when_), args_(std::move(log.args_))
+    {
+    }
+
+    std::atomic<Record*> next_;
+    Log::Severity sev_;
+    char const * loc_;
+    int line_;
+    std::time_t time_;
+    std::chrono::steady_clock::time_point when_;
+    std::string args_; // rendered by Log::render
+};
+
+// lock free queue for any number of producers and one consumer,
+// tail_ always points to an already consumed record
+class Log::RecordQueue
+{
+public:
+    RecordQueue(): head_(new Record), tail_(head_.load()) {}
+    ~RecordQueue() { while (pop()) {} delete tail_; }
+
+    void push(Record * record)
+    {
+        Record * prev = head_.exchange(record);
+        prev->next_.store(record, std::memory_order_release);
+    }
+
+    // returns the next record, it is valid until the next call
+    Record * pop()
+    {
+        Record * next = tail_->next_.load(std::memory_order_acquire);
+        if (next)
+        {
+            delete tail_;
+            tail_ = next;
+        }
+        return next;
+    }
+
+private:
+    std::atomic<Record*> head_;
+    Record * tail_;
+};
+
+Log::RecordQueue Log::queue_;
+static std::atomic<bool> async_(false);
+static std::atomic<int> pushing_(0); // producers between checking async_ and pushing
+static std::atomic<bool> stopWriter_(false);
+static std::thread writer_;
+static std::mutex asyncMutex_; // serializes enabling and disabling async mode
+static int const FlushMilliseconds = 100;
+
+// monotonic time of the records is logged relative to this
+static std::chrono::steady_clock::time_point const start_ = std::chrono::steady_clock::now();
+
+// time stamp of the last written second, protected by m
+static std::time_t stampTime_ = -1;
+static char stamp_[16];
+
+// rotation settings and state, protected by m
+static std::size_t maxBytes_ = 10*1024*1024;
+static int maxSeconds_ = 0;
+static int keepFiles_ = 5;
+static bool compress_ = false;
+static std::size_t bytes_ = 0; // written to the current log file
+static std::time_t openTime_ = 0;
+static std::thread compressor_; // gzips the last rotated file
+static std::atomic<bool> compressing_(false); // compressor_ is still running
+
+// last records for writeFatalRecords, protected by m
+static std::vector<std::string> fatalRecords_(100);
+static std::size_t fatalRecordsNext_ = 0;
+
+// set by the first crash handler
+static std::atomic<bool> crashing_(false);
+static std::terminate_handler previousTerminate_ = nullptr;
+
+// disables async mode and waits for compression at exit
+static struct ExitGuard
+{
+    ~ExitGuard()
+    {
+        Log::async(false);
+        std::lock_guard<std::mutex> lock(m);
+        if (compressor_.joinable()) compressor_.join();
+    }
+} exitGuard_;
+
+static
+std::string rotatedName(std::string const & fileName, int index, bool compressed)
+{
+    return fileName + "." + std::to_string(index) + (compressed ? ".gz" : "");
+}
+
+static
+void gzip(std::string fileName)
+{
+    char gzipName[] = "gzip";
+    char force[] = "-f";
+    char * argv[] = { gzipName, force, &fileName[0], nullptr };
+    pid_t pid;
+    if (posix_spawnp(&pid, "gzip", nullptr, nullptr, argv, environ) == 0)
+    {
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    compressing_ = false;
+}
+
+// module name to its minimum severity, negative if not overridden
+typedef std::map<std::string, std::unique_ptr<std::atomic<int>>> Modules;
+
+static std::mutex modulesMutex_;
+
+static
+Modules & modules()
+{
+    // function static as modules register themselves during static initialization
+    static Modules modules;
+    return modules;
+}
+
+static
+std::atomic<int> & moduleSeverity(std::string const & name)
+{
+    // called with modulesMutex_ locked
+    std::unique_ptr<std::atomic<int>> & sev = modules()[name];
+    if (!sev)
+    {
+        sev.reset(new std::atomic<int>(-1));
+    }
+    return *sev;
+}
+
+static
+std::string moduleName(char const * filePath)
+{
+    char const * pos = std::strrchr(filePath, '/');
+    std::string name(pos ? pos+1 : filePath);
+    return name.substr(0, name.find('.'));
+}
+
+static
+std::string trim(std::string const & str)
+{
+    std::size_t const begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos) return std::string();
+    std::size_t const end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+LogModule::LogModule(char const * filePath)
+{
+    std::lock_guard<std::mutex> lock(modulesMutex_);
+    sev_ = &moduleSeverity(moduleName(filePath));
+}
+
+thread_local int LogRateLimit::lastSuppressed_ = 0;
+
 static char const * const severityStrings[] =
 {
   "D-", "I-", "W-", "E-", "F-"
 };
 
-Log::Log(Severity sev, char const * loc, int line)
-: sev_(sev)
+Log::Log(Severity sev, char const * loc, int line, int suppressed):
+    sev_(sev),
+    loc_(loc),
+    line_(line),
+    suppressed_(suppressed),
+    time_(std::time(0)),
+    when_(std::chrono::steady_clock::now())
 {
-    // time stamp
-    char buf[16];
-    std::time_t t = std::time(0);
-    tm_ = *std::localtime(&t);
-    std::strftime(buf, 16, "%H:%M:%S", &tm_);
-
-    oss_ << severityStrings[sev_] << buf << "-" << basename(loc) << ":" << line << "] ";
 }
 
 Log::~Log()
 {
-    std::lock_guard<std::mutex> lock(m);
+    if (suppressed_ > 0)
+    {
+        *this << " (" << suppressed_ << " suppressed)";
+    }
+
+    ++pushing_;
+    if (async_)
+    {
+        queue_.push(new Record(*this));
+        --pushing_;
+    }
+    else
+    {
+        --pushing_;
+        Record const record(*this);
+        std::lock_guard<std::mutex> lock(m);
+        write(record, true);
+    }
+
+    if (sev_ == Fatal)
+    {
+        async(false);
+        {
+            std::lock_guard<std::mutex> lock(m);
+            writeFatalRecords();
+        }
+        std::abort();
+    }
+}
+
+void Log::render(std::string const & args, std::string & out)
+{
+    // formats like std::ostream with default flags
+    char buf[32];
+    char const * p = args.data();
+    char const * const end = p + args.size();
+    while (p < end)
+    {
+        ArgType const type = static_cast<ArgType>(*p++);
+        switch (type)
+        {
+        case ArgString:
+        {
+            uint32_t size;
+            std::memcpy(&size, p, sizeof(size));
+            p += sizeof(size);
+            out.append(p, size);
+            p += size;
+            break;
+        }
+        case ArgChar:
+            out.push_back(*p++);
+            break;
+        case ArgBool:
+        {
+            bool value;
+            std::memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            out.push_back(value ? '1' : '0');
+            break;
+        }
+        case ArgInt:
+        {
+            int64_t value;
+            std::memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            out.append(buf, std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(value)));
+            break;
+        }
+        case ArgUint:
+        {
+            uint64_t value;
+            std::memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            out.append(buf, std::snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(value)));
+            break;
+        }
+        case ArgDouble:
+        {
+            double value;
+            std::memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            out.append(buf, std::snprintf(buf, sizeof(buf), "%g", value));
+            break;
+        }
+        case ArgPointer:
+        {
+            void const * value;
+            std::memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            if (value)
+            {
+                out.append(buf, std::snprintf(buf, sizeof(buf), "%p", value));
+            }
+            else
+            {
+                out.push_back('0');
+            }
+            break;
+        }
+        }
+    }
+}
 
-    if (sev_ >= Log::Info)
+void Log::write(Record const & record, bool flush)
+{
+    // called with m locked
+
+    if (record.time_ != stampTime_)
+    {
+        std::tm tm;
+        localtime_r(&record.time_, &tm);
+        std::strftime(stamp_, sizeof(stamp_), "%H:%M:%S", &tm);
+        stampTime_ = record.time_;
+    }
+    long long const ms = std::chrono::duration_cast<std::chrono::milliseconds>(record.when_ - start_).count();
+
+    char prefix[128];
+    std::snprintf(prefix, sizeof(prefix), "%s%s-%lld.%03lld-%s:%d] ",
+        severityStrings[record.sev_], stamp_, ms/1000, ms%1000, basename(record.loc_), record.line_);
+
+    // the line is formatted into the ring of last records and written from there
+    std::string & line = fatalRecords_[fatalRecordsNext_];
+    line.assign(prefix);
+    render(record.args_, line);
+    fatalRecordsNext_ = (fatalRecordsNext_ + 1) % fatalRecords_.size();
+
+    if (record.sev_ >= Log::Info)
     {
-        std::cout << oss_.str() << std::endl;
+        std::cout << line << '\n';
+        if (flush) std::cout.flush();
     }
 
     if (!ofs_.is_open())
@@ -44,52 +347,306 @@ Log::~Log()
         if (0 == earlyLogs_.tellp())
         {
             char bufFirst[32];
-            std::strftime(bufFirst, 32, "%F %T %z", &tm_);
+            std::tm tm;
+            localtime_r(&record.time_, &tm);
+            std::strftime(bufFirst, 32, "%F %T %z", &tm);
             earlyLogs_ << "NEW LOG SESSION " << bufFirst << std::endl;
         }
 
         if (fileName_.empty())
         {
-            earlyLogs_ << oss_.str() << std::endl;
+            earlyLogs_ << line << std::endl;
+            return;
         }
-        else
+
+        openFile(record.time_);
+        ofs_ << earlyLogs_.str();
+        bytes_ += earlyLogs_.tellp();
+    }
+
+    ofs_ << line << '\n';
+    if (flush) ofs_.flush();
+    bytes_ += line.size() + 1;
+
+    // postponed while the previous file is compressed, gzip removes it by name when done and
+    // waiting for it would block the logging thread
+    if ( ((maxBytes_ != 0 && bytes_ >= maxBytes_) ||
+          (maxSeconds_ != 0 && record.time_ - openTime_ >= maxSeconds_)) && !compressing_ )
+    {
+        rotate(record.time_);
+    }
+}
+
+void Log::openFile(std::time_t time)
+{
+    // called with m locked
+    if (std::FILE * file = std::fopen(fileName_.c_str(), "r"))
+    {
+        bool const empty = std::fgetc(file) == EOF;
+        std::fclose(file);
+        if (!empty)
         {
-            ofs_.open(fileName_);
-            if (!ofs_.good())
-            {
-                std::cout << "failed to open log file: " << fileName_ << std::endl;
-                std::abort();
-            }
-            ofs_ << earlyLogs_.str();
-            ofs_ << oss_.str() << std::endl;
+            rotate(time);
+            return;
         }
     }
-    else
+
+    ofs_.open(fileName_);
+    if (!ofs_.good())
     {
-        ofs_ << oss_.str() << std::endl;
+        std::cout << "failed to open log file: " << fileName_ << std::endl;
+        std::abort();
     }
+    bytes_ = 0;
+    openTime_ = time;
+}
 
-    if (sev_ == Fatal)
+void Log::rotate(std::time_t time)
+{
+    // called with m locked
+    ofs_.close();
+
+    // the previous compression must be done before its file is renamed, it normally is
+    if (compressor_.joinable()) compressor_.join();
+
+    std::remove(rotatedName(fileName_, keepFiles_, false).c_str());
+    std::remove(rotatedName(fileName_, keepFiles_, true).c_str());
+    for (int i = keepFiles_ - 1; i >= 1; --i)
+    {
+        std::rename(rotatedName(fileName_, i, false).c_str(), rotatedName(fileName_, i+1, false).c_str());
+        std::rename(rotatedName(fileName_, i, true).c_str(), rotatedName(fileName_, i+1, true).c_str());
+    }
+
+    if (keepFiles_ > 0)
+    {
+        std::string const rotated = rotatedName(fileName_, 1, false);
+        std::rename(fileName_.c_str(), rotated.c_str());
+        if (compress_)
+        {
+            compressing_ = true;
+            compressor_ = std::thread(&gzip, rotated);
+        }
+    }
+
+    ofs_.open(fileName_);
+    if (!ofs_.good())
     {
+        std::cout << "failed to open log file: " << fileName_ << std::endl;
         std::abort();
     }
+    bytes_ = 0;
+    openTime_ = time;
+}
+
+void Log::writeFatalRecords()
+{
+    // called with m locked
+    if (fileName_.empty()) return;
+
+    std::ofstream ofs(fileName_ + ".fatal");
+    for (std::size_t i = 0; i < fatalRecords_.size(); ++i)
+    {
+        std::string const & record = fatalRecords_[(fatalRecordsNext_ + i) % fatalRecords_.size()];
+        if (!record.empty())
+        {
+            ofs << record << '\n';
+        }
+    }
+}
+
+void Log::writeQueued()
+{
+    // called from the single consumer of queue_
+    std::lock_guard<std::mutex> lock(m);
+    bool written = false;
+    while (Record * record = queue_.pop())
+    {
+        write(*record, false);
+        written = true;
+    }
+    if (written)
+    {
+        std::cout.flush();
+        ofs_.flush();
+    }
+}
+
+void Log::writerThread()
+{
+    while (!stopWriter_)
+    {
+        writeQueued();
+        std::this_thread::sleep_for(std::chrono::milliseconds(FlushMilliseconds));
+    }
+    writeQueued();
+}
+
+void Log::crash()
+{
+    // the crash can be on the writer thread or on a thread holding m or asyncMutex_, so unlike
+    // FATAL the writer is not joined and m is waited for only a while
+    if (crashing_.exchange(true)) return;
+    async_ = false; // records of other threads are written directly from now on
+
+    std::unique_lock<std::mutex> lock(m, std::defer_lock);
+    for (int i = 0; i < 200 && !lock.try_lock(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!lock.owns_lock()) return;
+
+    while (Record * record = queue_.pop())
+    {
+        write(*record, false);
+    }
+    std::cout.flush();
+    ofs_.flush();
+    writeFatalRecords();
+}
+
+void Log::crashSignal(int sig)
+{
+    crash();
+    // the handler was reset to the default one, which now terminates
+    std::raise(sig);
+}
+
+void Log::crashTerminate()
+{
+    crash();
+    if (previousTerminate_) previousTerminate_();
+    std::abort();
+}
+
+void Log::installCrashHandlers()
+{
+    struct sigaction action;
+    action.sa_handler = &Log::crashSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESETHAND | SA_NODEFER;
+
+    for (int sig : { SIGABRT, SIGSEGV, SIGBUS, SIGFPE, SIGILL })
+    {
+        sigaction(sig, &action, nullptr);
+    }
+
+    std::terminate_handler const previous = std::set_terminate(&Log::crashTerminate);
+    if (previous != &Log::crashTerminate)
+    {
+        previousTerminate_ = previous;
+    }
+}
+
+void Log::async(bool enable)
+{
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    if (enable == async_) return;
+
+    if (enable)
+    {
+        stopWriter_ = false;
+        writer_ = std::thread(&Log::writerThread);
+        async_ = true;
+    }
+    else
+    {
+        async_ = false;
+        while (pushing_ != 0)
+        {
+            std::this_thread::yield();
+        }
+        stopWriter_ = true;
+        writer_.join(); // the writer never logs itself, so this is not the writer thread
+    }
+}
+
+bool Log::async()
+{
+    return async_;
 }
 
 void Log::logFile(std::string const & fileName)
 {
+    // the async writer thread reads fileName_
+    std::lock_guard<std::mutex> lock(m);
     fileName_ = fileName;
 }
 
-std::string const & Log::logFile()
+std::string Log::logFile()
 {
+    std::lock_guard<std::mutex> lock(m);
     return fileName_;
 }
 
+void Log::rotation(std::size_t maxBytes, int maxSeconds, int keepFiles, bool compress)
+{
+    std::lock_guard<std::mutex> lock(m);
+    maxBytes_ = maxBytes;
+    maxSeconds_ = maxSeconds;
+    keepFiles_ = std::max(keepFiles, 0);
+    compress_ = compress;
+}
+
+void Log::fatalRecords(std::size_t count)
+{
+    std::lock_guard<std::mutex> lock(m);
+    fatalRecords_.assign(std::max(count, std::size_t(1)), std::string());
+    fatalRecordsNext_ = 0;
+}
+
 void Log::minSeverity(Severity sev)
 {
     minSev_ = sev;
 }
 
+void Log::moduleSeverities(std::string const & spec)
+{
+    static char const * const severityNames[] = { "debug", "info", "warning", "error", "fatal" };
+
+    // parse everything before changing anything
+    std::vector<std::pair<std::string, int>> severities;
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ','))
+    {
+        item = trim(item);
+        if (item.empty()) continue;
+
+        std::size_t const pos = item.find('=');
+        if (pos == std::string::npos)
+        {
+            throw std::invalid_argument("missing '=' in '" + item + "'");
+        }
+        std::string const name = trim(item.substr(0, pos));
+        std::string level = trim(item.substr(pos+1));
+        for (char & c : level)
+        {
+            c = std::tolower(static_cast<unsigned char>(c));
+        }
+
+        int sev = -1;
+        for (int i = Debug; i <= Fatal; ++i)
+        {
+            if (level == severityNames[i]) sev = i;
+        }
+        if (name.empty() || sev < 0)
+        {
+            throw std::invalid_argument("bad module severity '" + item + "'");
+        }
+        severities.push_back(std::make_pair(name, sev));
+    }
+
+    std::lock_guard<std::mutex> lock(modulesMutex_);
+    for (Modules::value_type & v : modules())
+    {
+        *v.second = -1;
+    }
+    for (auto const & v : severities)
+    {
+        moduleSeverity(v.first) = v.second;
+    }
+}
+
 char const * Log::basename(char const * filePath)
 {
     char const * pos = std::strrchr(filePath, '/');
@@ -4,7 +4,11 @@
 
 #include <sstream>
 #include <fstream>
+#include <string>
+#include <atomic>
+#include <chrono>
 #include <ctime>
+#include <cstdint>
 
 class Log
 {
@@ -18,30 +22,114 @@ public:
         Fatal
     };
 
-    Log(Severity sev, const char* loc, int line);
+    Log(Severity sev, const char* loc, int line, int suppressed = 0); // suppressed records are noted at the end
     ~Log();
 
-    std::ostream & get()
+    Log & get()
     {
-        return oss_;
+        return *this;
+    }
+
+    // strings and numbers are captured and only formatted when the record is written, on the writer
+    // thread in async mode, other types are formatted right away with their operator<<, stream
+    // manipulators have no effect
+    Log & operator<<(char const * value);
+    Log & operator<<(std::string const & value);
+    Log & operator<<(char value);
+    Log & operator<<(signed char value);
+    Log & operator<<(unsigned char value);
+    Log & operator<<(bool value);
+    Log & operator<<(short value);
+    Log & operator<<(unsigned short value);
+    Log & operator<<(int value);
+    Log & operator<<(unsigned int value);
+    Log & operator<<(long value);
+    Log & operator<<(unsigned long value);
+    Log & operator<<(long long value);
+    Log & operator<<(unsigned long long value);
+    Log & operator<<(float value);
+    Log & operator<<(double value);
+    Log & operator<<(void const * value);
+
+    template <typename T>
+    Log & operator<<(T const & value)
+    {
+        std::ostringstream oss;
+        oss << value;
+        return *this << oss.str();
     }
 
     static void logFile(std::string const & fileName); // must be called before log file creation to have effect
-    static std::string const & logFile();
+    static std::string logFile();
     static void minSeverity(Severity sev);
     static Severity minSeverity() { return minSev_; }
 
+    // per module minimum severities overriding minSeverity, a module is a source file name without extension,
+    // e.g. "Model=debug, ServerConn=warning", throws std::invalid_argument for a bad spec
+    static void moduleSeverities(std::string const & spec);
+
+    // when enabled records are queued and written by a background thread,
+    // disabling writes everything still queued, FATAL disables it before aborting
+    static void async(bool enable);
+    static bool async();
+
+    // the log file is rotated when it reaches maxBytes or is older than maxSeconds (0 for no limit),
+    // keepFiles rotated files are kept as <logFile>.1 ... <logFile>.N, compressed with gzip if compress is set,
+    // an existing log file is rotated when it is opened
+    static void rotation(std::size_t maxBytes, int maxSeconds, int keepFiles, bool compress);
+
+    // number of last records written to <logFile>.fatal on FATAL
+    static void fatalRecords(std::size_t count);
+
+    // writes the queued records and <logFile>.fatal on std::terminate and on SIGABRT, SIGSEGV,
+    // SIGBUS, SIGFPE and SIGILL, e.g. from abort() or a failed assert, then crashes as before
+    static void installCrashHandlers();
+
 private:
+    struct Record; // defined in Log.cpp
+    class RecordQueue;
+
     static std::ostringstream earlyLogs_; // things logged before logfile is opened
     static std::ofstream ofs_;
     static std::string fileName_;
     static Severity minSev_;
+    static RecordQueue queue_;
 
-    std::tm tm_;
+    // the prefix is only formatted when the record is written
     Severity sev_;
-    std::ostringstream oss_;
+    char const * loc_;
+    int line_;
+    int suppressed_;
+    std::time_t time_;
+    std::chrono::steady_clock::time_point when_;
+    std::string args_; // ArgType followed by the value, strings are prefixed with their size
+
+    enum ArgType : char
+    {
+        ArgString,
+        ArgChar,
+        ArgBool,
+        ArgInt,
+        ArgUint,
+        ArgDouble,
+        ArgPointer
+    };
+
+    template <typename T>
+    void put(ArgType type, T value);
+    void putString(char const * data, std::size_t size);
+    static void render(std::string const & args, std::string & out);
 
     static char const * basename(char const * filePath);
+    static void write(Record const & record, bool flush);
+    static void writeQueued();
+    static void openFile(std::time_t time);
+    static void rotate(std::time_t time);
+    static void writeFatalRecords();
+    static void writerThread();
+    static void crash();
+    static void crashSignal(int sig);
+    static void crashTerminate();
 
 };
 
@@ -58,15 +146,51 @@ Log::Severity const WARNING = Log::Warning;
 Log::Severity const ERROR = Log::Error;
 Log::Severity const FATAL = Log::Fatal;
 
+// minimum severity of the source file including Log.h
+class LogModule
+{
+public:
+    LogModule(char const * filePath);
+
+    Log::Severity minSeverity() const;
+
+private:
+    std::atomic<int> * sev_; // negative if not overridden
+};
+
+static LogModule const logModule_(__BASE_FILE__);
+
+// limits a log site to a number of records per second
+class LogRateLimit
+{
+public:
+    LogRateLimit(): second_(0), count_(0), suppressed_(0) {}
+
+    bool allow(int perSecond, std::time_t now = std::time(0));
+
+    // number of records dropped before the last allowed one on this thread
+    static int lastSuppressed();
+
+private:
+    std::atomic<std::time_t> second_;
+    std::atomic<int> count_;
+    std::atomic<int> suppressed_; // since the last allowed record
+    static thread_local int lastSuppressed_;
+};
+
 class LogVoidify
 {
 public:
     LogVoidify() { }
-    void operator&(std::ostream&) { } // This has to be an operator with a precedence lower than << but higher than ?:
+    void operator&(Log&) { } // This has to be an operator with a precedence lower than << but higher than ?:
 };
 
-#define LOG(sev) (sev < Log::minSeverity()) ? (void)0 : LogVoidify() & Log(sev, __FILE__, __LINE__).get()
-#define LOG_IF(sev, cond) (sev < Log::minSeverity() || !(cond)) ? (void)0 : LogVoidify() & Log(sev, __FILE__, __LINE__).get()
+#define LOG(sev) (sev < logModule_.minSeverity()) ? (void)0 : LogVoidify() & Log(sev, __FILE__, __LINE__).get()
+#define LOG_IF(sev, cond) (sev < logModule_.minSeverity() || !(cond)) ? (void)0 : LogVoidify() & Log(sev, __FILE__, __LINE__).get()
+// for high volume sites, records above perSecond are dropped and counted in the next written one
+#define LOG_RATE(sev, perSecond) (sev < logModule_.minSeverity() || \
+    ![]() -> LogRateLimit & { static LogRateLimit limit; return limit; }().allow(perSecond)) ? \
+    (void)0 : LogVoidify() & Log(sev, __FILE__, __LINE__, LogRateLimit::lastSuppressed()).get()
 
 /* TODO remove when i know i dont need DLOG
 #ifndef NDEBUG
@@ -77,3 +201,80 @@ public:
     #define DLOG_IF(sev, test) (true || !(test)) ? (void)0 : LogVoidify() & LOG(sev)
 #endif
 */
+
+// inline methods
+
+template <typename T>
+inline void Log::put(ArgType type, T value)
+{
+    args_.push_back(type);
+    args_.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+inline void Log::putString(char const * data, std::size_t size)
+{
+    put(ArgString, static_cast<uint32_t>(size));
+    args_.append(data, size);
+}
+
+inline Log & Log::operator<<(char const * value)
+{
+    if (value)
+    {
+        putString(value, std::char_traits<char>::length(value));
+    }
+    else
+    {
+        putString("(null)", 6);
+    }
+    return *this;
+}
+
+inline Log & Log::operator<<(std::string const & value)
+{
+    putString(value.data(), value.size());
+    return *this;
+}
+
+inline Log & Log::operator<<(char value) { put(ArgChar, value); return *this; }
+inline Log & Log::operator<<(signed char value) { put(ArgChar, static_cast<char>(value)); return *this; }
+inline Log & Log::operator<<(unsigned char value) { put(ArgChar, static_cast<char>(value)); return *this; }
+inline Log & Log::operator<<(bool value) { put(ArgBool, value); return *this; }
+inline Log & Log::operator<<(short value) { put(ArgInt, static_cast<int64_t>(value)); return *this; }
+inline Log & Log::operator<<(unsigned short value) { put(ArgUint, static_cast<uint64_t>(value)); return *this; }
+inline Log & Log::operator<<(int value) { put(ArgInt, static_cast<int64_t>(value)); return *this; }
+inline Log & Log::operator<<(unsigned int value) { put(ArgUint, static_cast<uint64_t>(value)); return *this; }
+inline Log & Log::operator<<(long value) { put(ArgInt, static_cast<int64_t>(value)); return *this; }
+inline Log & Log::operator<<(unsigned long value) { put(ArgUint, static_cast<uint64_t>(value)); return *this; }
+inline Log & Log::operator<<(long long value) { put(ArgInt, static_cast<int64_t>(value)); return *this; }
+inline Log & Log::operator<<(unsigned long long value) { put(ArgUint, static_cast<uint64_t>(value)); return *this; }
+inline Log & Log::operator<<(float value) { put(ArgDouble, static_cast<double>(value)); return *this; }
+inline Log & Log::operator<<(double value) { put(ArgDouble, value); return *this; }
+inline Log & Log::operator<<(void const * value) { put(ArgPointer, value); return *this; }
+
+inline Log::Severity LogModule::minSeverity() const
+{
+    int const sev = sev_ ? sev_->load(std::memory_order_relaxed) : -1;
+    return sev < 0 ? Log::minSeverity() : static_cast<Log::Severity>(sev);
+}
+
+inline bool LogRateLimit::allow(int perSecond, std::time_t now)
+{
+    std::time_t second = second_.load(std::memory_order_relaxed);
+    if (second != now && second_.compare_exchange_strong(second, now))
+    {
+        count_ = 0;
+    }
+    if (count_++ < perSecond)
+    {
+        lastSuppressed_ = suppressed_.exchange(0);
+        return true;
+    }
+    ++suppressed_;
+    return false;
+}
+
+inline int LogRateLimit::lastSuppressed()
+{
+    return lastSuppressed_;
+}
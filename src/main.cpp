@@ -97,6 +97,8 @@ int main(int argc, char * argv[])
         printUsage(argv[0], errorMsg);
     }
 
+    Log::installCrashHandlers();
+    Log::async(true);
     LOG(INFO)<< "starting flobby "<< FLOBBY_VERSION << ", command line '" << commandLine << "'";
     initDirs(dir_);
 
@@ -124,5 +126,7 @@ int main(int argc, char * argv[])
     // shutdown pr-downloader
     // TODO DownloadShutdown();
 
+    Log::async(false);
+
     return 0;
 }
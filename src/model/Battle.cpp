@@ -2,6 +2,7 @@
 
 #include "Battle.h"
 #include "User.h"
+#include "Bot.h"
 #include "LobbyProtocol.h"
 
 #include "log/Log.h"
@@ -14,7 +15,8 @@ Battle::Battle(std::istream & is): // battleId type natType founder IP port maxP
         spectators_(0), // set to 1 below if replay
         locked_(false), // only set to true by UPDATEBATTLEINFO
         running_(false), // set by founder status
-        modHash_(0)
+        modHash_(0),
+        botUsers_(0)
 {
     using namespace LobbyProtocol;
 
@@ -74,7 +76,8 @@ Battle::Battle(std::istream & is): // battleId type natType founder IP port maxP
 
 Battle::Battle(Json::Value & jv):
         locked_(false), // only set to true by UPDATEBATTLEINFO
-        modHash_(0)
+        modHash_(0),
+        botUsers_(0)
 {
     id_ = jv["BattleID"].asInt();
 
@@ -159,7 +162,12 @@ void Battle::joined(User const & user)
     if (!res.second)
     {
         LOG(WARNING) << "user " << user.name() << " already joined battle " << title();
+        return;
     }
+
+    Member const m = member(user);
+    members_[user.name()] = m;
+    count(m, 1);
 }
 
 void Battle::left(User const & user)
@@ -169,36 +177,116 @@ void Battle::left(User const & user)
     {
         LOG(WARNING) << "user " << user.name() << " was not in battle " << title();
     }
+
+    Members::iterator it = members_.find(user.name());
+    if (it != members_.end())
+    {
+        count(it->second, -1);
+        members_.erase(it);
+    }
 }
 
-int Battle::playerCount() const
+void Battle::userChanged(User const & user)
 {
-    int playerCount = 0;
-
-    for (BattleUsers::value_type const& pairNamePtr: users_)
+    Members::iterator it = members_.find(user.name());
+    if (it != members_.end())
     {
-        if (!pairNamePtr.second->status().bot())
+        Member const m = member(user);
+        if (m != it->second)
         {
-            ++playerCount;
+            count(it->second, -1);
+            count(m, 1);
+            it->second = m;
         }
     }
+}
+
+void Battle::botAdded(Bot const & bot)
+{
+    botRemoved(bot); // in case bot is re-added
+    Member const m = member(bot);
+    bots_[bot.name()] = m;
+    count(m, 1);
+}
 
-    return playerCount;
+void Battle::botChanged(Bot const & bot)
+{
+    Members::iterator it = bots_.find(bot.name());
+    if (it != bots_.end())
+    {
+        count(it->second, -1);
+        it->second = member(bot);
+        count(it->second, 1);
+    }
+    else
+    {
+        botAdded(bot);
+    }
 }
 
-int Battle::spectators() const
+void Battle::botRemoved(Bot const & bot)
 {
-    int spectatorCount = spectators_;
+    Members::iterator it = bots_.find(bot.name());
+    if (it != bots_.end())
+    {
+        count(it->second, -1);
+        bots_.erase(it);
+    }
+}
 
-    for (BattleUsers::value_type const& pairNamePtr: users_)
+void Battle::removeBots()
+{
+    for (Members::value_type const & pair : bots_)
     {
-        if (pairNamePtr.second->status().bot())
+        count(pair.second, -1);
+    }
+    bots_.clear();
+}
+
+Battle::Member Battle::member(User const & user)
+{
+    Member m;
+    m.bot_ = user.status().bot();
+    m.allyTeam_ = user.battleStatus().spectator() ? -1 : user.battleStatus().allyTeam();
+    return m;
+}
+
+Battle::Member Battle::member(Bot const & bot)
+{
+    Member m;
+    m.bot_ = false; // AI bots are not counted as users
+    m.allyTeam_ = bot.battleStatus().spectator() ? -1 : bot.battleStatus().allyTeam();
+    return m;
+}
+
+void Battle::count(Member const & member, int delta)
+{
+    if (member.bot_)
+    {
+        botUsers_ += delta;
+    }
+    if (member.allyTeam_ >= 0)
+    {
+        int & n = allyTeamCounts_[member.allyTeam_];
+        n += delta;
+        if (n <= 0)
         {
-            --spectatorCount;
+            allyTeamCounts_.erase(member.allyTeam_);
         }
     }
+}
+
+Battle::BattleUsers Battle::close()
+{
+    BattleUsers users;
+    users.swap(users_);
+
+    members_.clear();
+    bots_.clear();
+    botUsers_ = 0;
+    allyTeamCounts_.clear();
 
-    return spectatorCount;
+    return users;
 }
 
 void Battle::print(std::ostream & os) const
@@ -9,6 +9,7 @@
 
 // forwards
 class User;
+class Bot;
 namespace Json {
     class Value;
 }
@@ -43,6 +44,7 @@ public:
     int userCount() const;
     int playerCount() const; // number of non-bot users
     int spectators() const; // excluding bot users
+    int botCount() const; // number of AI bots, only maintained for joined battle
     bool locked() const;
     bool running() const;
     bool running(bool running); // returns true if running status changed
@@ -51,6 +53,13 @@ public:
     void updateBattleUpdate(Json::Value & jv);
     void joined(User const & user);
     void left(User const & user);
+    void userChanged(User const & user); // call when status or battle status of a user in battle changed
+
+    // AI bots, only sent for the joined battle
+    void botAdded(Bot const & bot);
+    void botChanged(Bot const & bot);
+    void botRemoved(Bot const & bot);
+    void removeBots();
 
     void modHash(unsigned int modHash) { modHash_ = modHash; }
     unsigned int modHash() const { return modHash_; }
@@ -64,6 +73,12 @@ public:
 
     typedef std::map<std::string, User const*, ciLessBoost> BattleUsers;
     BattleUsers const& users() const;
+    BattleUsers close(); // removes all users from battle, returns the removed users
+
+    // number of non-spec players (including AI bots) in each ally team,
+    // only valid for joined battle since battle status is only sent for users in joined battle
+    typedef std::map<int, int> AllyTeamCounts;
+    AllyTeamCounts const& allyTeamCounts() const;
 
     void print(std::ostream & os) const;
 
@@ -94,6 +109,23 @@ private:
     unsigned int modHash_;
 
     BattleUsers users_;
+
+    // what a user or AI bot adds to the counters below
+    struct Member
+    {
+        bool bot_; // user with bot status
+        int allyTeam_; // -1 if spectator
+        bool operator!=(Member const & other) const { return bot_ != other.bot_ || allyTeam_ != other.allyTeam_; }
+    };
+    typedef std::map<std::string, Member, ciLessBoost> Members;
+    Members members_; // users
+    Members bots_; // AI bots
+    int botUsers_;
+    AllyTeamCounts allyTeamCounts_;
+
+    static Member member(User const & user);
+    static Member member(Bot const & bot);
+    void count(Member const & member, int delta);
 };
 
 // inline methods
@@ -203,6 +235,21 @@ inline int Battle::userCount() const
     return users_.size();
 }
 
+inline int Battle::playerCount() const
+{
+    return userCount() - botUsers_;
+}
+
+inline int Battle::spectators() const
+{
+    return spectators_ - botUsers_;
+}
+
+inline int Battle::botCount() const
+{
+    return bots_.size();
+}
+
 inline bool Battle::running() const
 {
     return running_;
@@ -213,6 +260,11 @@ inline Battle::BattleUsers const&  Battle::users() const
     return users_;
 }
 
+inline Battle::AllyTeamCounts const& Battle::allyTeamCounts() const
+{
+    return allyTeamCounts_;
+}
+
 
 // global functions
 //
@@ -0,0 +1,46 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include "Signal.h"
+
+#include <unordered_map>
+#include <string>
+#include <utility>
+
+// one signal per key, e.g. channel name, so an emission only reaches the slots connected for that key
+// first argument of Signature is the key
+template <typename Signature>
+class KeyedSignal
+{
+public:
+    typedef ::Signal<Signature> KeySignal;
+    typedef typename KeySignal::slot_type slot_type;
+
+    SignalConnection connect(std::string const & key, slot_type const & subscriber);
+
+    template <typename... Args>
+    void operator()(std::string const & key, Args &&... args);
+
+private:
+    std::unordered_map<std::string, KeySignal> signals_;
+};
+
+// inline methods
+
+template <typename Signature>
+inline SignalConnection KeyedSignal<Signature>::connect(std::string const & key, slot_type const & subscriber)
+{
+    return signals_[key].connect(subscriber);
+}
+
+template <typename Signature>
+template <typename... Args>
+inline void KeyedSignal<Signature>::operator()(std::string const & key, Args &&... args)
+{
+    typename std::unordered_map<std::string, KeySignal>::iterator it = signals_.find(key);
+    if (it != signals_.end())
+    {
+        it->second(key, std::forward<Args>(args)...);
+    }
+}
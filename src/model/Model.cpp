@@ -11,6 +11,7 @@
 #include "UserId.h"
 #include "ServerCommands.h"
 #include "Nightwatch.h"
+#include "PixelConvert.h"
 
 #include "md5/md5.h"
 #include "md5/base64.h"
@@ -254,7 +255,7 @@ void Model::attemptLogin()
 
 void Model::message(std::string const & msg)
 {
-    LOG(DEBUG) << "message: " << msg;
+    LOG_RATE(DEBUG, 100) << "message: " << msg;
 
     processServerMsg(msg);
 }
@@ -434,6 +435,12 @@ const Battle & Model::getBattle(int battleId)
     return *it->second;
 }
 
+Battle const * Model::findBattle(int battleId) const
+{
+    auto it = battles_.find(battleId);
+    return (it != battles_.end()) ? it->second.get() : 0;
+}
+
 std::vector<User const *> Model::getUsers()
 {
     std::vector<User const *> users;
@@ -451,6 +458,12 @@ User const & Model::getUser(std::string const & str)
     return user(str);
 }
 
+User const * Model::findUser(std::string const & str) const
+{
+    auto it = users_.find(str);
+    return (it != users_.end()) ? it->second.get() : 0;
+}
+
 User & Model::user(std::string const & str)
 {
     auto it = users_.find(str);
@@ -471,6 +484,12 @@ Bot & Model::getBot(std::string const & str)
     return *it->second;
 }
 
+Bot const * Model::findBot(std::string const & str) const
+{
+    Bots::const_iterator it = bots_.find(str);
+    return (it != bots_.end()) ? it->second : 0;
+}
+
 Model::Bots const & Model::getBots()
 {
     return bots_;
@@ -491,6 +510,7 @@ void Model::meSpec(bool spec)
     UserBattleStatus ubs = u.battleStatus();
     ubs.spectator(spec);
     u.battleStatus(ubs);
+    updateBattleCounts(u);
 
     sendMyBattleStatus();
 }
@@ -511,6 +531,7 @@ void Model::meAllyTeam(int allyTeam)
     UserBattleStatus ubs = u.battleStatus();
     ubs.allyTeam(allyTeam);
     u.battleStatus(ubs);
+    updateBattleCounts(u);
 
     sendMyBattleStatus();
 }
@@ -805,6 +826,15 @@ void Model::disconnect()
     controller_.disconnect();
 }
 
+void Model::updateBattleCounts(User const & user)
+{
+    auto it = battles_.find(user.joinedBattle());
+    if (it != battles_.end())
+    {
+        it->second->userChanged(user);
+    }
+}
+
 void Model::updateBattleRunningStatus(User const & user)
 {
     // TODO should we break when founder found ? yes, if a user cannot be founder of multiple battles
@@ -830,24 +860,7 @@ std::unique_ptr<uint8_t[]>  Model::getMapImage(std::string const & mapName, int
     {
         int const size = (1024 >> mipLevel)*(1024 >> mipLevel);
         res.reset(new uint8_t[size*3]);
-        uint8_t * p = res.get();
-        for (int i=0; i<size; ++i)
-        {
-            unsigned char r5 = (*rgb565 & 0xf800) >> 11;
-            unsigned char g6 = (*rgb565 & 0x07e0) >> 5;
-            unsigned char b5 = *rgb565 & 0x001f;
-
-            unsigned char r8 = (r5 << 3) | (r5 >> 2);
-            unsigned char g8 = (g6 << 2) | (g6 >> 4);
-            unsigned char b8 = (b5 << 3) | (b5 >> 2);
-
-            p[0] = r8;
-            p[1] = g8;
-            p[2] = b8;
-
-            rgb565 += 1;
-            p += 3;
-        }
+        rgb565ToRgb888(rgb565, res.get(), size);
     }
 
     return res;
@@ -1180,6 +1193,7 @@ void Model::handle_User(std::istream & is) // User content
                     userLeftBattleSignal_(user, b);
                     if (user == me() && b.id () == joinedBattleId_) {
                         joinedBattleId_ = -1;
+                        b.removeBots();
                         bots_.clear();
                     }
                 }
@@ -1314,18 +1328,32 @@ void Model::handle_BATTLECLOSED(std::istream & is) // battleId
     std::string ex;
     extractWord(is, ex);
     int const battleId = boost::lexical_cast<int>(ex);
-    Battle const & battle = getBattle(battleId);
 
-    // simulate LEFTBATTLE messages since uberserver do not send this before BATTLECLOSED
-    auto const users = battle.users(); // we need to a copy here since handle_LEFTBATTLE changes battle users map
-    for (auto const& pairNameUser : users)
+    // uberserver do not send LEFTBATTLE before BATTLECLOSED, closeBattle removes all users
+    closeBattle(battle(battleId));
+}
+
+void Model::closeBattle(Battle & b)
+{
+    int const battleId = b.id();
+
+    Battle::BattleUsers const leftUsers = b.close();
+    for (auto const& pairNameUser : leftUsers)
     {
-        std::stringstream ss;
-        ss << battle.id() << " " << pairNameUser.first;
-        handle_LEFTBATTLE(ss);
+        Users::iterator it = users_.find(pairNameUser.second->name());
+        if (it != users_.end() && it->second->joinedBattle() == battleId)
+        {
+            it->second->leftBattle(b);
+        }
     }
 
-    battleClosedSignal_(battle);
+    if (battleId == joinedBattleId_)
+    {
+        joinedBattleId_ = -1;
+        bots_.clear();
+    }
+
+    battleClosedSignal_(b, leftUsers);
 
     battles_.erase(battleId);
 }
@@ -1337,13 +1365,7 @@ void Model::handle_BattleRemoved(std::istream & is)
 
     int const battleId = jv["BattleID"].asInt();
 
-    Battle const & battle = getBattle(battleId);
-
-    // TODO i probably don't need LEFTBATTLE workaround here
-
-    battleClosedSignal_(battle);
-
-    battles_.erase(battleId);
+    closeBattle(battle(battleId));
 }
 
 void Model::handle_UPDATEBATTLEINFO(std::istream & is) // battleId spectatorCount locked mapHash {mapName}
@@ -1477,6 +1499,7 @@ void Model::handle_JoinBattleSuccess(std::istream & is)
         b.joined(u);
         u.joinedBattle(b);
         u.updateUserBattleStatus(userBattleStatus);
+        b.userChanged(u);
 
         userJoinedBattleSignal_(u, b);
         userChangedSignal_(u);
@@ -1486,6 +1509,7 @@ void Model::handle_JoinBattleSuccess(std::istream & is)
     auto bs = me().battleStatus();
     bs.spectator(true);
     me().battleStatus(bs);
+    b.userChanged(me());
     sendMyInitialBattleStatus(b);
     battleJoinedSignal_(b);
 
@@ -1516,6 +1540,7 @@ void Model::handle_LEFTBATTLE(std::istream & is) // battleId username
     if (u == me() && b.id () == joinedBattleId_)
     {
         joinedBattleId_ = -1;
+        b.removeBots();
         bots_.clear();
     }
 }
@@ -1538,6 +1563,7 @@ void Model::handle_LeftBattle(std::istream & is)
     if (u == me() && b.id () == joinedBattleId_)
     {
         joinedBattleId_ = -1;
+        b.removeBots();
         bots_.clear();
     }
 }
@@ -1550,6 +1576,7 @@ void Model::handle_CLIENTSTATUS(std::istream & is) // userName status
     User & u = user(ex);
     extractWord(is, ex);
     u.status(UserStatus(ex));
+    updateBattleCounts(u);
     updateBattleRunningStatus(u);
     if (loggedIn_)
     {
@@ -1574,6 +1601,7 @@ void Model::handle_JOINBATTLE(std::istream & is) // battleId hashCode
     extractWord(is, ex);
     b.modHash( static_cast<unsigned int>( boost::lexical_cast<int64_t>(ex)) );
     script_.clear();
+    b.removeBots();
     bots_.clear();
     LOG(DEBUG) << "modHash " << b.modHash();
     LOG(DEBUG) << "mapHash " << b.mapHash();
@@ -1647,6 +1675,7 @@ void Model::handle_CLIENTBATTLESTATUS(std::istream & is) // userName battleStatu
     User & u = user(ex);
     extractWord(is, ex);
     u.battleStatus(UserBattleStatus(ex));
+    updateBattleCounts(u);
 
     extractWord(is, ex);
     u.color(boost::lexical_cast<int>(ex));
@@ -1661,6 +1690,7 @@ void Model::handle_UpdateUserBattleStatus(std::istream & is)
 
     User& u = user(jv["Name"].asString());
     u.updateUserBattleStatus(jv);
+    updateBattleCounts(u);
     userChangedSignal_(u);
 }
 
@@ -1711,6 +1741,7 @@ void Model::handle_ADDBOT(std::istream & is) // battleId name owner battleStatus
     {
         Bot * b = new Bot(is);
         bots_[b->name()] = b;
+        battle(battleId).botAdded(*b);
         botAddedSignal_(*b);
     }
 }
@@ -1728,6 +1759,7 @@ void Model::handleUpdateBotStatus(Json::Value& jv)
     if (-1 != joinedBattleId_)
     {
         std::string const& botName = jv["Name"].asString();
+        Battle & b = battle(joinedBattleId_);
 
         Bots::iterator it = bots_.find(botName);
         if (it != bots_.end())
@@ -1735,14 +1767,16 @@ void Model::handleUpdateBotStatus(Json::Value& jv)
             // existing bot, update
             Bot& bot = *it->second;
             bot.updateBotStatus(jv);
+            b.botChanged(bot);
             botChangedSignal_(bot);
         }
         else
         {
             // new bot
-            Bot* b = new Bot(jv);
-            bots_[b->name()] = b;
-            botAddedSignal_(*b);
+            Bot* bot = new Bot(jv);
+            bots_[bot->name()] = bot;
+            b.botAdded(*bot);
+            botAddedSignal_(*bot);
         }
     }
     else
@@ -1761,6 +1795,7 @@ void Model::handle_REMOVEBOT(std::istream & is) // battleId name
     {
         extractWord(is, ex);
         Bot & b = getBot(ex);
+        battle(battleId).botRemoved(b);
         botRemovedSignal_(b);
         bots_.erase(ex);
     }
@@ -1775,6 +1810,7 @@ void Model::handle_RemoveBot(std::istream & is)
 
         std::string const name = jv["Name"].asString();
         Bot& b = getBot(name);
+        battle(joinedBattleId_).botRemoved(b);
         botRemovedSignal_(b);
         bots_.erase(name);
     }
@@ -1799,6 +1835,7 @@ void Model::handle_UPDATEBOT(std::istream & is) // battleId name battleStatus te
         b.battleStatus(UserBattleStatus(ex));
         extractWord(is, ex);
         b.color(boost::lexical_cast<int>(ex));
+        battle(battleId).botChanged(b);
         botChangedSignal_(b);
     }
 }
@@ -1864,10 +1901,13 @@ void Model::handle_JoinChannelResponse(std::istream & is)
         channelJoinedSignal_(channelName);
 
         Json::Value const& jvUsers = jv["Channel"]["Users"];
+        std::vector<std::string> clients;
+        clients.reserve(jvUsers.size());
         for (Json::ValueConstIterator it = jvUsers.begin(); it != jvUsers.end(); ++it)
         {
-            userJoinedChannelSignal_(channelName, (*it).asString());
+            clients.push_back((*it).asString());
         }
+        channelClientsSignal_(channelName, clients);
     }
     else
     {
@@ -2563,33 +2603,32 @@ void Model::addBot(Bot const & bot)
 
 void Model::botAllyTeam(std::string const& name, int allyTeam)
 {
-    try
+    Bot const * bot = findBot(name);
+    if (!bot)
     {
-        Bot const& bot = getBot(name); // throws if bot not found
-        UserBattleStatus ubs = bot.battleStatus();
-        ubs.allyTeam(allyTeam);
-        if (zerok_)
-        {
-            std::ostringstream oss;
-            Json::Value jv;
-            jv["Name"] = bot.name();
-            jv["AllyNumber"] = ubs.allyTeam();
-            // jv["TeamNumber"] = bot.battleStatus().team();
-            jv["AiLib"] = bot.aiDll();
-            jv["Owner"] = userName_;
+        // silently ignore non-existing bot
+        return;
+    }
 
-            Json::FastWriter writer;
-            oss << "UpdateBotStatus " << writer.write(jv);
-            controller_.send(oss.str());
-        }
-        else
-        {
-            sendUpdateBot(name, ubs, bot.color());
-        }
+    UserBattleStatus ubs = bot->battleStatus();
+    ubs.allyTeam(allyTeam);
+    if (zerok_)
+    {
+        std::ostringstream oss;
+        Json::Value jv;
+        jv["Name"] = bot->name();
+        jv["AllyNumber"] = ubs.allyTeam();
+        // jv["TeamNumber"] = bot->battleStatus().team();
+        jv["AiLib"] = bot->aiDll();
+        jv["Owner"] = userName_;
+
+        Json::FastWriter writer;
+        oss << "UpdateBotStatus " << writer.write(jv);
+        controller_.send(oss.str());
     }
-    catch (std::invalid_argument const& e)
+    else
     {
-        // silently ignore non-existing bot
+        sendUpdateBot(name, ubs, bot->color());
     }
 }
 
@@ -2601,18 +2640,17 @@ void Model::botSide(std::string const& name, int side)
         return;
     }
 
-    try
-    {
-        Bot const& bot = getBot(name); // throws if bot not found
-        UserBattleStatus ubs = bot.battleStatus();
-        ubs.side(side);
-
-        sendUpdateBot(name, ubs, bot.color());
-    }
-    catch (std::invalid_argument const& e)
+    Bot const * bot = findBot(name);
+    if (!bot)
     {
         // silently ignore non-existing bot
+        return;
     }
+
+    UserBattleStatus ubs = bot->battleStatus();
+    ubs.side(side);
+
+    sendUpdateBot(name, ubs, bot->color());
 }
 
 void Model::sendUpdateBot(std::string const& name, UserBattleStatus const& ubs, int color)
@@ -13,8 +13,9 @@
 #include "StartRect.h"
 #include "ServerInfo.h"
 #include "AI.h"
+#include "Signal.h"
+#include "KeyedSignal.h"
 
-#include <boost/signals2/signal.hpp>
 #include <sstream>
 #include <unordered_map>
 #include <functional>
@@ -56,11 +57,14 @@ public:
     void renameAccount(std::string const & username);
 
     std::vector<Battle const *> getBattles();
-    Battle const & getBattle(int battleId);
+    Battle const & getBattle(int battleId); // throws if not found
+    Battle const * findBattle(int battleId) const; // returns 0 if not found
 
     std::vector<User const *> getUsers();
-    User const & getUser(std::string const & str);
-    Bot & getBot(std::string const & str);
+    User const & getUser(std::string const & str); // throws if not found
+    User const * findUser(std::string const & str) const; // returns 0 if not found
+    Bot & getBot(std::string const & str); // throws if not found
+    Bot const * findBot(std::string const & str) const; // returns 0 if not found
 
     typedef std::map<std::string,Bot*> Bots;
     Bots const & getBots();
@@ -129,156 +133,158 @@ public:
 
     // signals
     //
-    typedef boost::signals2::signal<void (bool connected)> ConnectedSignal;
-    boost::signals2::connection connectConnected(ConnectedSignal::slot_type subscriber)
+    typedef Signal<void (bool connected)> ConnectedSignal;
+    SignalConnection connectConnected(ConnectedSignal::slot_type subscriber)
     { return connectedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (ServerInfo const & serverInfo)> ServerInfoSignal;
-    boost::signals2::connection connectServerInfo(ServerInfoSignal::slot_type subscriber)
+    typedef Signal<void (ServerInfo const & serverInfo)> ServerInfoSignal;
+    SignalConnection connectServerInfo(ServerInfoSignal::slot_type subscriber)
     { return serverInfoSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (bool success, std::string const & msg)> LoginResultSignal;
-    boost::signals2::connection connectLoginResult(LoginResultSignal::slot_type subscriber)
+    typedef Signal<void (bool success, std::string const & msg)> LoginResultSignal;
+    SignalConnection connectLoginResult(LoginResultSignal::slot_type subscriber)
     { return loginResultSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (bool success, std::string const & msg)> RegisterResultSignal;
-    boost::signals2::connection connectRegisterResult(RegisterResultSignal::slot_type subscriber)
+    typedef Signal<void (bool success, std::string const & msg)> RegisterResultSignal;
+    SignalConnection connectRegisterResult(RegisterResultSignal::slot_type subscriber)
     { return registerResultSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & text)> AgreementSignal;
-    boost::signals2::connection connectAgreement(AgreementSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & text)> AgreementSignal;
+    SignalConnection connectAgreement(AgreementSignal::slot_type subscriber)
     { return agreementSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (User const & user)> UserJoinedSignal;
-    boost::signals2::connection connectUserJoined(UserJoinedSignal::slot_type subscriber)
+    typedef Signal<void (User const & user)> UserJoinedSignal;
+    SignalConnection connectUserJoined(UserJoinedSignal::slot_type subscriber)
     { return userJoinedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (User const & user)> UserChangedSignal;
-    boost::signals2::connection connectUserChanged(UserChangedSignal::slot_type subscriber)
+    typedef Signal<void (User const & user)> UserChangedSignal;
+    SignalConnection connectUserChanged(UserChangedSignal::slot_type subscriber)
     { return userChangedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (User const & user)> UserLeftSignal;
-    boost::signals2::connection connectUserLeft(UserLeftSignal::slot_type subscriber)
+    typedef Signal<void (User const & user)> UserLeftSignal;
+    SignalConnection connectUserLeft(UserLeftSignal::slot_type subscriber)
     { return userLeftSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (Battle const & battle)> BattleOpenedSignal;
-    boost::signals2::connection connectBattleOpened(BattleOpenedSignal::slot_type subscriber)
+    typedef Signal<void (Battle const & battle)> BattleOpenedSignal;
+    SignalConnection connectBattleOpened(BattleOpenedSignal::slot_type subscriber)
     { return battleOpenedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (Battle const & battle)> BattleClosedSignal;
-    boost::signals2::connection connectBattleClosed(BattleClosedSignal::slot_type subscriber)
+    // leftUsers are the users that were in the battle when it closed, they are not signaled with UserLeftBattle
+    typedef Signal<void (Battle const & battle, Battle::BattleUsers const & leftUsers)> BattleClosedSignal;
+    SignalConnection connectBattleClosed(BattleClosedSignal::slot_type subscriber)
     { return battleClosedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (Battle const & battle)> BattleChangedSignal;
-    boost::signals2::connection connectBattleChanged(BattleChangedSignal::slot_type subscriber)
+    typedef Signal<void (Battle const & battle)> BattleChangedSignal;
+    SignalConnection connectBattleChanged(BattleChangedSignal::slot_type subscriber)
     { return battleChangedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (Battle const & battle)> BattleJoinedSignal;
-    boost::signals2::connection connectBattleJoined(BattleJoinedSignal::slot_type subscriber)
+    typedef Signal<void (Battle const & battle)> BattleJoinedSignal;
+    SignalConnection connectBattleJoined(BattleJoinedSignal::slot_type subscriber)
     { return battleJoinedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & reason)> JoinBattleFailedSignal;
-    boost::signals2::connection connectJoinBattleFailed(JoinBattleFailedSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & reason)> JoinBattleFailedSignal;
+    SignalConnection connectJoinBattleFailed(JoinBattleFailedSignal::slot_type subscriber)
     { return joinBattleFailedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (User const & user, Battle const & battle)> UserJoinedBattleSignal;
-    boost::signals2::connection connectUserJoinedBattle(UserJoinedBattleSignal::slot_type subscriber)
+    typedef Signal<void (User const & user, Battle const & battle)> UserJoinedBattleSignal;
+    SignalConnection connectUserJoinedBattle(UserJoinedBattleSignal::slot_type subscriber)
     { return userJoinedBattleSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (User const & user, Battle const & battle)> UserLeftBattleSignal;
-    boost::signals2::connection connectUserLeftBattle(UserLeftBattleSignal::slot_type subscriber)
+    typedef Signal<void (User const & user, Battle const & battle)> UserLeftBattleSignal;
+    SignalConnection connectUserLeftBattle(UserLeftBattleSignal::slot_type subscriber)
     { return userLeftBattleSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (Bot const & bot)> BotAddedSignal;
-    boost::signals2::connection connectBotAdded(BotAddedSignal::slot_type subscriber)
+    typedef Signal<void (Bot const & bot)> BotAddedSignal;
+    SignalConnection connectBotAdded(BotAddedSignal::slot_type subscriber)
     { return botAddedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (Bot const & bot)> BotChangedSignal;
-    boost::signals2::connection connectBotChanged(BotChangedSignal::slot_type subscriber)
+    typedef Signal<void (Bot const & bot)> BotChangedSignal;
+    SignalConnection connectBotChanged(BotChangedSignal::slot_type subscriber)
     { return botChangedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (Bot const & bot)> BotRemovedSignal;
-    boost::signals2::connection connectBotRemoved(BotRemovedSignal::slot_type subscriber)
+    typedef Signal<void (Bot const & bot)> BotRemovedSignal;
+    SignalConnection connectBotRemoved(BotRemovedSignal::slot_type subscriber)
     { return botRemovedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & userName, std::string const & msg)> BattleChatMsgSignal;
-    boost::signals2::connection connectBattleChatMsg(BattleChatMsgSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & userName, std::string const & msg)> BattleChatMsgSignal;
+    SignalConnection connectBattleChatMsg(BattleChatMsgSignal::slot_type subscriber)
     { return battleChatMsgSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void ()> SpringExitSignal;
-    boost::signals2::connection connectSpringExit(SpringExitSignal::slot_type subscriber)
+    typedef Signal<void ()> SpringExitSignal;
+    SignalConnection connectSpringExit(SpringExitSignal::slot_type subscriber)
     { return springExitSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (DownloadType downloadType, std::string const & name, bool success)> DownloadDoneSignal;
-    boost::signals2::connection connectDownloadDone(DownloadDoneSignal::slot_type subscriber)
+    typedef Signal<void (DownloadType downloadType, std::string const & name, bool success)> DownloadDoneSignal;
+    SignalConnection connectDownloadDone(DownloadDoneSignal::slot_type subscriber)
     { return downloadDoneSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & msg, int interest)> ServerMsgSignal;
-    boost::signals2::connection connectServerMsg(ServerMsgSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & msg, int interest)> ServerMsgSignal;
+    SignalConnection connectServerMsg(ServerMsgSignal::slot_type subscriber)
     { return serverMsgSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & userName, std::string const & msg)> SayPrivateSignal;
-    boost::signals2::connection connectSayPrivate(SayPrivateSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & userName, std::string const & msg)> SayPrivateSignal;
+    SignalConnection connectSayPrivate(SayPrivateSignal::slot_type subscriber)
     { return sayPrivateSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & userName, std::string const & msg)> SaidPrivateSignal;
-    boost::signals2::connection connectSaidPrivate(SaidPrivateSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & userName, std::string const & msg)> SaidPrivateSignal;
+    SignalConnection connectSaidPrivate(SaidPrivateSignal::slot_type subscriber)
     { return saidPrivateSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (Channels const &)> ChannelsSignal;
-    boost::signals2::connection connectChannels(ChannelsSignal::slot_type subscriber)
+    typedef Signal<void (Channels const &)> ChannelsSignal;
+    SignalConnection connectChannels(ChannelsSignal::slot_type subscriber)
     { return channelsSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & channelName)> ChannelJoinedSignal;
-    boost::signals2::connection connectChannelJoined(ChannelJoinedSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & channelName)> ChannelJoinedSignal;
+    SignalConnection connectChannelJoined(ChannelJoinedSignal::slot_type subscriber)
     { return channelJoinedSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & channelName, std::string const & author, time_t epochSeconds, std::string const & topic)> ChannelTopicSignal;
-    boost::signals2::connection connectChannelTopicSignal(ChannelTopicSignal::slot_type subscriber)
-    { return channelTopicSignal_.connect(subscriber); }
+    // channel signals are only emitted to slots connected for the channel
+    typedef KeyedSignal<void (std::string const & channelName, std::string const & author, time_t epochSeconds, std::string const & topic)> ChannelTopicSignal;
+    SignalConnection connectChannelTopicSignal(std::string const & channelName, ChannelTopicSignal::slot_type subscriber)
+    { return channelTopicSignal_.connect(channelName, subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & channelName, std::string const & message)> ChannelMessageSignal;
-    boost::signals2::connection connectChannelMessageSignal(ChannelMessageSignal::slot_type subscriber)
-    { return channelMessageSignal_.connect(subscriber); }
+    typedef KeyedSignal<void (std::string const & channelName, std::string const & message)> ChannelMessageSignal;
+    SignalConnection connectChannelMessageSignal(std::string const & channelName, ChannelMessageSignal::slot_type subscriber)
+    { return channelMessageSignal_.connect(channelName, subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & channelName, std::vector<std::string> const & clients)> ChannelClientsSignal;
-    boost::signals2::connection connectChannelClients(ChannelClientsSignal::slot_type subscriber)
-    { return channelClientsSignal_.connect(subscriber); }
+    typedef KeyedSignal<void (std::string const & channelName, std::vector<std::string> const & clients)> ChannelClientsSignal;
+    SignalConnection connectChannelClients(std::string const & channelName, ChannelClientsSignal::slot_type subscriber)
+    { return channelClientsSignal_.connect(channelName, subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & channelName, std::string const & userName)> UserJoinedChannelSignal;
-    boost::signals2::connection connectUserJoinedChannel(UserJoinedChannelSignal::slot_type subscriber)
-    { return userJoinedChannelSignal_.connect(subscriber); }
+    typedef KeyedSignal<void (std::string const & channelName, std::string const & userName)> UserJoinedChannelSignal;
+    SignalConnection connectUserJoinedChannel(std::string const & channelName, UserJoinedChannelSignal::slot_type subscriber)
+    { return userJoinedChannelSignal_.connect(channelName, subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & channelName, std::string const & userName, std::string const & reason)> UserLeftChannelSignal;
-    boost::signals2::connection connectUserLeftChannel(UserLeftChannelSignal::slot_type subscriber)
-    { return userLeftChannelSignal_.connect(subscriber); }
+    typedef KeyedSignal<void (std::string const & channelName, std::string const & userName, std::string const & reason)> UserLeftChannelSignal;
+    SignalConnection connectUserLeftChannel(std::string const & channelName, UserLeftChannelSignal::slot_type subscriber)
+    { return userLeftChannelSignal_.connect(channelName, subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & channelName, std::string const & userName, std::string const & message)> SaidChannelSignal;
-    boost::signals2::connection connectSaidChannel(SaidChannelSignal::slot_type subscriber)
-    { return saidChannelSignal_.connect(subscriber); }
+    typedef KeyedSignal<void (std::string const & channelName, std::string const & userName, std::string const & message)> SaidChannelSignal;
+    SignalConnection connectSaidChannel(std::string const & channelName, SaidChannelSignal::slot_type subscriber)
+    { return saidChannelSignal_.connect(channelName, subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & userName)> RingSignal;
-    boost::signals2::connection connectRing(RingSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & userName)> RingSignal;
+    SignalConnection connectRing(RingSignal::slot_type subscriber)
     { return ringSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (StartRect const & startRect)> AddStartRectSignal;
-    boost::signals2::connection connectAddStartRect(AddStartRectSignal::slot_type subscriber)
+    typedef Signal<void (StartRect const & startRect)> AddStartRectSignal;
+    SignalConnection connectAddStartRect(AddStartRectSignal::slot_type subscriber)
     { return addStartRectSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (int ally)> RemoveStartRectSignal;
-    boost::signals2::connection connectRemoveStartRect(RemoveStartRectSignal::slot_type subscriber)
+    typedef Signal<void (int ally)> RemoveStartRectSignal;
+    SignalConnection connectRemoveStartRect(RemoveStartRectSignal::slot_type subscriber)
     { return removeStartRectSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & key, std::string const & value)> SetScriptTagSignal;
-    boost::signals2::connection connectSetScriptTag(SetScriptTagSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & key, std::string const & value)> SetScriptTagSignal;
+    SignalConnection connectSetScriptTag(SetScriptTagSignal::slot_type subscriber)
     { return setScriptTagSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const & key)> RemoveScriptTagSignal;
-    boost::signals2::connection connectRemoveScriptTag(RemoveScriptTagSignal::slot_type subscriber)
+    typedef Signal<void (std::string const & key)> RemoveScriptTagSignal;
+    SignalConnection connectRemoveScriptTag(RemoveScriptTagSignal::slot_type subscriber)
     { return removeScriptTagSignal_.connect(subscriber); }
 
-    typedef boost::signals2::signal<void (std::string const& engineVersion, std::string const& demoFile)> StartDemoSignal;
-    boost::signals2::connection connectStartDemo(StartDemoSignal::slot_type subscriber)
+    typedef Signal<void (std::string const& engineVersion, std::string const& demoFile)> StartDemoSignal;
+    SignalConnection connectStartDemo(StartDemoSignal::slot_type subscriber)
     { return startDemoSignal_.connect(subscriber); }
 
 private:
@@ -389,7 +395,9 @@ private:
     User & user(std::string const & str);
     Battle & getBattle(std::string const & str);
     Battle & battle(int battleId);
+    void closeBattle(Battle & battle); // remove all users from battle, signal battle closed and remove battle
     void updateBattleRunningStatus(User const & user); // signal battle changed if user is founder of battle
+    void updateBattleCounts(User const & user); // call when status or battle status of user changed
 
     void sendMyInitialBattleStatus(Battle const & battle);
     void sendMyBattleStatus();
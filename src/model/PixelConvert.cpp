@@ -0,0 +1,257 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#include "PixelConvert.h"
+
+#include <cstring>
+#include <cassert>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PIXEL_CONVERT_AVX2
+#endif
+
+// The SIMD paths build one 32 bit word per pixel with the components in the low three bytes
+// and then drop the fourth byte when storing.
+
+namespace
+{
+    void rgb565Scalar(uint16_t const* src, uint8_t* dst, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            uint16_t const p = src[i];
+            uint8_t const r5 = (p & 0xf800) >> 11;
+            uint8_t const g6 = (p & 0x07e0) >> 5;
+            uint8_t const b5 = p & 0x001f;
+
+            dst[0] = (r5 << 3) | (r5 >> 2);
+            dst[1] = (g6 << 2) | (g6 >> 4);
+            dst[2] = (b5 << 3) | (b5 >> 2);
+            dst += 3;
+        }
+    }
+
+    void greyScalar(uint8_t const* src, uint8_t* dst, std::size_t count, uint8_t rMask, uint8_t gMask, uint8_t bMask)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            uint8_t const v = src[i];
+            dst[0] = v & rMask;
+            dst[1] = v & gMask;
+            dst[2] = v & bMask;
+            dst += 3;
+        }
+    }
+
+    uint32_t rgbMask(uint8_t rMask, uint8_t gMask, uint8_t bMask)
+    {
+        return rMask | (gMask << 8) | (bMask << 16);
+    }
+
+#if defined(__SSE2__)
+    // stores the low three bytes of the four words in v, 12 bytes
+    void storeRgb4(uint8_t* dst, __m128i v)
+    {
+        // within each 64 bit half: word0 | word1 << 24
+        __m128i const low = _mm_and_si128(v, _mm_set_epi32(0, 0xffffff, 0, 0xffffff));
+        __m128i const high = _mm_srli_epi64(_mm_and_si128(v, _mm_set_epi32(0xffffff, 0, 0xffffff, 0)), 8);
+        __m128i const halves = _mm_or_si128(low, high);
+        // move the 6 bytes of the upper half next to the lower half
+        __m128i const packed = _mm_or_si128(_mm_and_si128(halves, _mm_set_epi32(0, 0, 0xffff, 0xffffffff)),
+                                            _mm_srli_si128(_mm_and_si128(halves, _mm_set_epi32(0xffff, 0xffffffff, 0, 0)), 2));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), packed);
+        int const last = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+        std::memcpy(dst + 8, &last, 4);
+    }
+
+    void rgb565Sse2(uint16_t const* src, uint8_t* dst, std::size_t count)
+    {
+        __m128i const mask8 = _mm_set1_epi16(0xf8);
+        __m128i const mask6 = _mm_set1_epi16(0xfc);
+        __m128i const mask3 = _mm_set1_epi16(0x07);
+        __m128i const mask2 = _mm_set1_epi16(0x03);
+
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i const p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+            __m128i const r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 8), mask8), _mm_srli_epi16(p, 13));
+            __m128i const g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 3), mask6), _mm_and_si128(_mm_srli_epi16(p, 9), mask2));
+            __m128i const b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(p, 3), mask8), _mm_and_si128(_mm_srli_epi16(p, 2), mask3));
+
+            __m128i const rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+            storeRgb4(dst + 3*i, _mm_unpacklo_epi16(rg, b));
+            storeRgb4(dst + 3*i + 12, _mm_unpackhi_epi16(rg, b));
+        }
+        rgb565Scalar(src + i, dst + 3*i, count - i);
+    }
+
+    void greySse2(uint8_t const* src, uint8_t* dst, std::size_t count, uint8_t rMask, uint8_t gMask, uint8_t bMask)
+    {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const mask = _mm_set1_epi32(rgbMask(rMask, gMask, bMask));
+
+        std::size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+            __m128i const v16[2] = { _mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero) };
+            for (int h = 0; h < 2; ++h)
+            {
+                __m128i const v32[2] = { _mm_unpacklo_epi16(v16[h], zero), _mm_unpackhi_epi16(v16[h], zero) };
+                for (int q = 0; q < 2; ++q)
+                {
+                    // v | v << 8 | v << 16
+                    __m128i const w = _mm_or_si128(v32[q], _mm_or_si128(_mm_slli_epi32(v32[q], 8), _mm_slli_epi32(v32[q], 16)));
+                    storeRgb4(dst + 3*(i + 8*h + 4*q), _mm_and_si128(w, mask));
+                }
+            }
+        }
+        greyScalar(src + i, dst + 3*i, count - i, rMask, gMask, bMask);
+    }
+#endif
+
+#if defined(PIXEL_CONVERT_AVX2)
+    // drops the fourth byte of each word within each 128 bit lane, the last 4 bytes of each lane are zero
+    __attribute__((target("avx2")))
+    __m256i compactRgb(__m256i v)
+    {
+        __m256i const shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                                 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        return _mm256_shuffle_epi8(v, shuffle);
+    }
+
+    __attribute__((target("avx2")))
+    void rgb565Avx2(uint16_t const* src, uint8_t* dst, std::size_t count)
+    {
+        __m256i const mask8 = _mm256_set1_epi16(0xf8);
+        __m256i const mask6 = _mm256_set1_epi16(0xfc);
+        __m256i const mask3 = _mm256_set1_epi16(0x07);
+        __m256i const mask2 = _mm256_set1_epi16(0x03);
+
+        // each 16 byte store writes 4 bytes past its 12, stop while there is room for them
+        std::size_t i = 0;
+        for (; i + 16 + 2 <= count; i += 16)
+        {
+            __m256i const p = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+            __m256i const r = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(p, 8), mask8), _mm256_srli_epi16(p, 13));
+            __m256i const g = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(p, 3), mask6), _mm256_and_si256(_mm256_srli_epi16(p, 9), mask2));
+            __m256i const b = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(p, 3), mask8), _mm256_and_si256(_mm256_srli_epi16(p, 2), mask3));
+
+            __m256i const rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+            // lanes: lo has pixels 0-3 and 8-11, hi has pixels 4-7 and 12-15
+            __m256i const lo = compactRgb(_mm256_unpacklo_epi16(rg, b));
+            __m256i const hi = compactRgb(_mm256_unpackhi_epi16(rg, b));
+
+            uint8_t* d = dst + 3*i;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d), _mm256_castsi256_si128(lo));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 12), _mm256_castsi256_si128(hi));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 24), _mm256_extracti128_si256(lo, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 36), _mm256_extracti128_si256(hi, 1));
+        }
+        _mm256_zeroupper(); // gcc does not always emit it before the tail call
+        rgb565Scalar(src + i, dst + 3*i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    void greyAvx2(uint8_t const* src, uint8_t* dst, std::size_t count, uint8_t rMask, uint8_t gMask, uint8_t bMask)
+    {
+        __m256i const mask = _mm256_set1_epi32(rgbMask(rMask, gMask, bMask));
+        __m256i const spread = _mm256_set1_epi32(0x010101);
+
+        std::size_t i = 0;
+        for (; i + 8 + 2 <= count; i += 8)
+        {
+            __m256i const v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(src + i)));
+            __m256i const w = compactRgb(_mm256_and_si256(_mm256_mullo_epi32(v, spread), mask));
+
+            uint8_t* d = dst + 3*i;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d), _mm256_castsi256_si128(w));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 12), _mm256_extracti128_si256(w, 1));
+        }
+        _mm256_zeroupper();
+        greyScalar(src + i, dst + 3*i, count - i, rMask, gMask, bMask);
+    }
+#endif
+}
+
+bool pixelConvertPathSupported(PixelConvertPath path)
+{
+    switch (path)
+    {
+    case PixelConvertScalar:
+        return true;
+
+    case PixelConvertSse2:
+#if defined(__SSE2__)
+        return true;
+#else
+        return false;
+#endif
+
+    case PixelConvertAvx2:
+#if defined(PIXEL_CONVERT_AVX2)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+PixelConvertPath pixelConvertBestPath()
+{
+    static PixelConvertPath const path =
+        pixelConvertPathSupported(PixelConvertAvx2) ? PixelConvertAvx2 :
+        pixelConvertPathSupported(PixelConvertSse2) ? PixelConvertSse2 : PixelConvertScalar;
+    return path;
+}
+
+void rgb565ToRgb888(uint16_t const* src, uint8_t* dst, std::size_t count, PixelConvertPath path)
+{
+    assert(pixelConvertPathSupported(path));
+
+    switch (path)
+    {
+#if defined(PIXEL_CONVERT_AVX2)
+    case PixelConvertAvx2:
+        rgb565Avx2(src, dst, count);
+        break;
+#endif
+#if defined(__SSE2__)
+    case PixelConvertSse2:
+        rgb565Sse2(src, dst, count);
+        break;
+#endif
+    default:
+        rgb565Scalar(src, dst, count);
+        break;
+    }
+}
+
+void greyToRgb888(uint8_t const* src, uint8_t* dst, std::size_t count, uint8_t rMask, uint8_t gMask, uint8_t bMask,
+                  PixelConvertPath path)
+{
+    assert(pixelConvertPathSupported(path));
+
+    switch (path)
+    {
+#if defined(PIXEL_CONVERT_AVX2)
+    case PixelConvertAvx2:
+        greyAvx2(src, dst, count, rMask, gMask, bMask);
+        break;
+#endif
+#if defined(__SSE2__)
+    case PixelConvertSse2:
+        greySse2(src, dst, count, rMask, gMask, bMask);
+        break;
+#endif
+    default:
+        greyScalar(src, dst, count, rMask, gMask, bMask);
+        break;
+    }
+}
@@ -0,0 +1,30 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// conversion of unitsync image data to packed 8 bit RGB
+
+// implementation used, all give identical results
+enum PixelConvertPath
+{
+    PixelConvertScalar,
+    PixelConvertSse2,
+    PixelConvertAvx2
+};
+
+// returns the fastest path supported by the cpu
+PixelConvertPath pixelConvertBestPath();
+
+bool pixelConvertPathSupported(PixelConvertPath path);
+
+// expands count RGB565 pixels to 3*count bytes, the low bits are filled with the high bits
+void rgb565ToRgb888(uint16_t const* src, uint8_t* dst, std::size_t count,
+                    PixelConvertPath path = pixelConvertBestPath());
+
+// expands count grey values to 3*count bytes, each component is the grey value masked,
+// e.g. masks 0, 0xff, 0 give a green image
+void greyToRgb888(uint8_t const* src, uint8_t* dst, std::size_t count, uint8_t rMask, uint8_t gMask, uint8_t bMask,
+                  PixelConvertPath path = pixelConvertBestPath());
@@ -0,0 +1,202 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+// Single threaded replacement for boost::signals2::signal used for Model events.
+// Connecting, disconnecting and emitting must all be done from the same thread.
+// Slots connected during an emission are not called until the next emission,
+// slots disconnected during an emission are not called after the disconnect.
+
+namespace SignalDetail
+{
+    struct SlotState
+    {
+        SlotState(): connected_(true) {}
+        bool connected_;
+    };
+}
+
+class SignalConnection
+{
+public:
+    SignalConnection() {}
+    explicit SignalConnection(std::weak_ptr<SignalDetail::SlotState> const & state): state_(state) {}
+
+    void disconnect() const;
+    bool connected() const;
+
+private:
+    std::weak_ptr<SignalDetail::SlotState> state_;
+};
+
+// disconnects when going out of scope
+class ScopedSignalConnection: public SignalConnection
+{
+public:
+    ScopedSignalConnection() {}
+    ScopedSignalConnection(SignalConnection const & connection): SignalConnection(connection) {}
+    ~ScopedSignalConnection() { disconnect(); }
+
+    ScopedSignalConnection & operator=(SignalConnection const & connection);
+
+private:
+    ScopedSignalConnection(ScopedSignalConnection const &) = delete;
+    ScopedSignalConnection & operator=(ScopedSignalConnection const &) = delete;
+};
+
+template <typename Signature>
+class Signal;
+
+template <typename... Args>
+class Signal<void (Args...)>
+{
+public:
+    typedef std::function<void (Args...)> slot_type;
+
+    Signal(): emitting_(0), disconnected_(false) {}
+    ~Signal();
+
+    SignalConnection connect(slot_type const & subscriber);
+    void disconnect_all_slots();
+    std::size_t num_slots() const;
+    bool empty() const;
+
+    void operator()(Args... args);
+
+private:
+    // heap allocated so a slot is not moved while it is called
+    struct Slot: SignalDetail::SlotState
+    {
+        Slot(slot_type const & function): function_(function) {}
+        slot_type function_;
+    };
+    std::vector<std::shared_ptr<Slot>> slots_;
+    int emitting_; // emission depth, slots_ is only compacted when zero
+    bool disconnected_; // slots_ may contain disconnected slots
+
+    void compact();
+
+    Signal(Signal const &) = delete;
+    Signal & operator=(Signal const &) = delete;
+};
+
+// inline methods
+
+inline void SignalConnection::disconnect() const
+{
+    if (std::shared_ptr<SignalDetail::SlotState> state = state_.lock())
+    {
+        state->connected_ = false;
+    }
+}
+
+inline bool SignalConnection::connected() const
+{
+    std::shared_ptr<SignalDetail::SlotState> state = state_.lock();
+    return state && state->connected_;
+}
+
+inline ScopedSignalConnection & ScopedSignalConnection::operator=(SignalConnection const & connection)
+{
+    disconnect();
+    SignalConnection::operator=(connection);
+    return *this;
+}
+
+template <typename... Args>
+inline Signal<void (Args...)>::~Signal()
+{
+    disconnect_all_slots();
+}
+
+template <typename... Args>
+inline SignalConnection Signal<void (Args...)>::connect(slot_type const & subscriber)
+{
+    if (emitting_ == 0 && disconnected_)
+    {
+        compact();
+    }
+    slots_.push_back(std::make_shared<Slot>(subscriber));
+    return SignalConnection(slots_.back());
+}
+
+template <typename... Args>
+inline void Signal<void (Args...)>::disconnect_all_slots()
+{
+    for (std::shared_ptr<Slot> const & slot : slots_)
+    {
+        slot->connected_ = false;
+    }
+    disconnected_ = true;
+    if (emitting_ == 0)
+    {
+        compact();
+    }
+}
+
+template <typename... Args>
+inline std::size_t Signal<void (Args...)>::num_slots() const
+{
+    std::size_t count = 0;
+    for (std::shared_ptr<Slot> const & slot : slots_)
+    {
+        if (slot->connected_) ++count;
+    }
+    return count;
+}
+
+template <typename... Args>
+inline bool Signal<void (Args...)>::empty() const
+{
+    return num_slots() == 0;
+}
+
+template <typename... Args>
+inline void Signal<void (Args...)>::operator()(Args... args)
+{
+    // index based since slots may connect to this signal and reallocate slots_
+    std::size_t const count = slots_.size();
+    ++emitting_;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Slot & slot = *slots_[i];
+        if (slot.connected_)
+        {
+            slot.function_(args...);
+        }
+        else
+        {
+            disconnected_ = true;
+        }
+    }
+    --emitting_;
+
+    if (emitting_ == 0 && disconnected_)
+    {
+        compact();
+    }
+}
+
+template <typename... Args>
+inline void Signal<void (Args...)>::compact()
+{
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < slots_.size(); ++i)
+    {
+        if (slots_[i]->connected_)
+        {
+            if (kept != i)
+            {
+                slots_[kept] = std::move(slots_[i]);
+            }
+            ++kept;
+        }
+    }
+    slots_.erase(slots_.begin() + kept, slots_.end());
+    disconnected_ = false;
+}
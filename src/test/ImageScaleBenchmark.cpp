@@ -0,0 +1,79 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+// Compares gui/ImageScale.h with the Magick resize previously used for map cache thumbnails,
+// i.e. a 1024x1024 RGB minimap and a 512x512 single channel height map scaled to 128x128.
+
+#include "gui/ImageScale.h"
+
+#include <Magick++.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    int const Iterations = 20;
+    int const ThumbnailSize = 128;
+
+    std::vector<uint8_t> randomImage(int w, int h, int d)
+    {
+        std::vector<uint8_t> data(w*h*d);
+        for (uint8_t & v : data) v = std::rand() % 256;
+        return data;
+    }
+
+    template <typename Function>
+    double run(Function function)
+    {
+        function(); // warm up
+        auto const start = std::chrono::steady_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+        {
+            function();
+        }
+        auto const stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(stop - start).count() / Iterations;
+    }
+
+    void benchmark(char const * name, int w, int h, int d, ImageFilter filter)
+    {
+        std::vector<uint8_t> const src = randomImage(w, h, d);
+        std::vector<uint8_t> dst(ThumbnailSize*ThumbnailSize*d);
+
+        double const magickMs = run([&]()
+        {
+            Magick::Image image;
+            image.read(w, h, d == 1 ? "I" : "RGB", Magick::CharPixel, src.data());
+            image.depth(8);
+            Magick::Geometry geom(ThumbnailSize, ThumbnailSize);
+            geom.aspect(true);
+            image.resize(geom);
+            image.write(0, 0, ThumbnailSize, ThumbnailSize, d == 1 ? "I" : "RGB", Magick::CharPixel, dst.data());
+        });
+
+        std::cout << name << " " << w << "x" << h << "x" << d << " -> " << ThumbnailSize << "x" << ThumbnailSize << std::endl
+                  << "  Magick resize: " << magickMs << " ms" << std::endl;
+
+        char const * const pathNames[] = { "scalar", "SSE2", "AVX2" };
+        for (ImageScalePath path : {ImageScaleScalar, ImageScaleSse2, ImageScaleAvx2})
+        {
+            if (!imageScalePathSupported(path)) continue;
+            double const ms = run([&]()
+            {
+                scaleImage(src.data(), w, h, dst.data(), ThumbnailSize, ThumbnailSize, d, filter, path);
+            });
+            std::cout << "  scaleImage " << pathNames[path] << ": " << ms << " ms" << std::endl;
+        }
+    }
+}
+
+int main(int, char * argv[])
+{
+    Magick::InitializeMagick(*argv);
+
+    benchmark("minimap, lanczos", 1024, 1024, 3, ImageFilterLanczos);
+    benchmark("height map, box", 512, 512, 1, ImageFilterBox);
+
+    return 0;
+}
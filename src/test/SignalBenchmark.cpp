@@ -0,0 +1,80 @@
+// This file is part of flobby (GPL v2 or later), see the LICENSE file
+
+// Compares emission cost of model/Signal.h with boost::signals2 for a login burst,
+// i.e. many user status messages each emitted to the handful of views connected to Model.
+
+#include "model/Signal.h"
+
+#include <boost/signals2/signal.hpp>
+#include <boost/bind.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    int const Slots = 8; // typical number of views connected to a Model signal
+    int const Users = 5000; // users on a busy server
+    int const MessagesPerUser = 20; // ADDUSER, CLIENTSTATUS and JOINEDBATTLE etc. during login
+
+    struct View
+    {
+        View(): count_(0) {}
+        void userChanged(std::string const & name) { count_ += name.size(); }
+        std::size_t count_;
+    };
+
+    template <typename Signal>
+    double run(Signal & signal, std::vector<std::string> const & names)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        for (int m = 0; m < MessagesPerUser; ++m)
+        {
+            for (std::string const & name : names)
+            {
+                signal(name);
+            }
+        }
+        auto const stop = std::chrono::steady_clock::now();
+        double const ns = std::chrono::duration<double, std::nano>(stop - start).count();
+        return ns / (static_cast<double>(names.size()) * MessagesPerUser);
+    }
+}
+
+int main()
+{
+    std::vector<std::string> names;
+    for (int i = 0; i < Users; ++i)
+    {
+        names.push_back("user" + std::to_string(i));
+    }
+
+    std::vector<View> views(Slots);
+
+    boost::signals2::signal<void (std::string const &)> boostSignal;
+    Signal<void (std::string const &)> signal;
+    for (View & view : views)
+    {
+        boostSignal.connect( boost::bind(&View::userChanged, &view, _1) );
+        signal.connect( boost::bind(&View::userChanged, &view, _1) );
+    }
+
+    // warm up
+    run(boostSignal, names);
+    run(signal, names);
+
+    double const boostNs = run(boostSignal, names);
+    double const signalNs = run(signal, names);
+
+    std::cout << "emissions: " << Users*MessagesPerUser << ", slots: " << Slots << std::endl
+              << "boost::signals2: " << boostNs << " ns/emission" << std::endl
+              << "Signal:          " << signalNs << " ns/emission" << std::endl;
+
+    std::size_t total = 0;
+    for (View const & view : views)
+    {
+        total += view.count_;
+    }
+    return total == 0; // use the result
+}
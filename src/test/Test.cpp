@@ -1,25 +1,41 @@
 // This file is part of flobby (GPL v2 or later), see the LICENSE file
 
 #include "model/Model.h"
+#include "model/Signal.h"
 #include "gui/MyImage.h"
 #include "gui/TextFunctions.h"
+#include "gui/BattleFilter.h"
+#include "gui/ImageScale.h"
+#include "gui/ThumbnailAtlas.h"
+#include "gui/MapInfoIndex.h"
 #include "log/Log.h"
 #include "FlobbyDirs.h"
 #include "model/Nightwatch.h"
 #include "model/LobbyProtocol.h"
+#include "model/PixelConvert.h"
 
 #include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
 #define BOOST_TEST_DYN_LINK // this will define BOOST_TEST_ALTERNATIVE_INIT_API in boost/test/detail/config.hpp
 #define BOOST_TEST_ALTERNATIVE_INIT_API // here for clarity
 #define BOOST_TEST_NO_MAIN
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <functional>
 #include <thread>
 #include <stdexcept>
 #include <sstream>
+#include <fstream>
+#include <iterator>
 #include <string>
 #include <memory>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <csignal>
 #include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
 
 static
 bool init_unit_test()
@@ -42,6 +58,56 @@ main( int argc, char* argv[] )
 }
 
 
+BOOST_AUTO_TEST_CASE(testSignal)
+{
+    Signal<void (int)> signal;
+    int sum = 0;
+
+    SignalConnection c1 = signal.connect( [&](int v) { sum += v; } );
+    BOOST_CHECK_EQUAL(signal.num_slots(), 1);
+    signal(1);
+    BOOST_CHECK_EQUAL(sum, 1);
+
+    // slot connected during emission is called from next emission
+    SignalConnection c2;
+    c2 = signal.connect( [&](int v) {
+        sum += 10*v;
+        c2.disconnect();
+        signal.connect( [&](int v) { sum += 100*v; } );
+    } );
+    signal(1);
+    BOOST_CHECK_EQUAL(sum, 12);
+    BOOST_CHECK(!c2.connected());
+    signal(1);
+    BOOST_CHECK_EQUAL(sum, 113);
+    BOOST_CHECK_EQUAL(signal.num_slots(), 2);
+
+    // scoped connection
+    {
+        ScopedSignalConnection sc(signal.connect( [&](int) { sum += 1000; } ));
+        signal(0);
+        BOOST_CHECK_EQUAL(sum, 1113);
+    }
+    signal(0);
+    BOOST_CHECK_EQUAL(sum, 1113);
+
+    c1.disconnect();
+    BOOST_CHECK(!c1.connected());
+    signal(1);
+    BOOST_CHECK_EQUAL(sum, 1213);
+
+    signal.disconnect_all_slots();
+    BOOST_CHECK(signal.empty());
+
+    // keyed signal only reaches slots of emitted key
+    KeyedSignal<void (std::string const &, int)> keyed;
+    keyed.connect("main", [&](std::string const & key, int v) { BOOST_CHECK_EQUAL(key, "main"); sum += v; } );
+    keyed.connect("other", [&](std::string const &, int) { BOOST_ERROR("wrong key"); } );
+    keyed("main", 1);
+    keyed("unknown", 1);
+    BOOST_CHECK_EQUAL(sum, 1214);
+}
+
 BOOST_AUTO_TEST_CASE(testUserStatus)
 {
     // test default ctor
@@ -358,6 +424,73 @@ BOOST_AUTO_TEST_CASE(testBattle)
         std::cout << b << std::endl;
     }
 
+    // user and bot counters
+    {
+        std::stringstream ssOpened("1 0 0 Founder 1.2.3.4 8452 16 0 0 0 spring\t104.0\tMap\tTitle\tGame");
+        Battle b(ssOpened);
+
+        std::stringstream ss1("player1 SE 0");
+        User u1(ss1);
+        std::stringstream ss2("player2 SE 0");
+        User u2(ss2);
+        std::stringstream ss3("autohost SE 0");
+        User u3(ss3);
+        UserStatus us;
+        us.bot(true);
+        u3.status(us);
+
+        UserBattleStatus ubs;
+        ubs.spectator(false);
+        ubs.allyTeam(0);
+        u1.battleStatus(ubs);
+        ubs.allyTeam(1);
+        u2.battleStatus(ubs);
+        ubs.spectator(true);
+        u3.battleStatus(ubs);
+
+        b.joined(u1);
+        b.joined(u2);
+        b.joined(u3);
+        BOOST_CHECK_EQUAL(b.userCount(), 3);
+        BOOST_CHECK_EQUAL(b.playerCount(), 2);
+        BOOST_CHECK_EQUAL(b.allyTeamCounts().size(), 2);
+        BOOST_CHECK_EQUAL(b.allyTeamCounts().at(0), 1);
+        BOOST_CHECK_EQUAL(b.allyTeamCounts().at(1), 1);
+
+        // player2 changes to ally team 0
+        ubs = u2.battleStatus();
+        ubs.allyTeam(0);
+        u2.battleStatus(ubs);
+        b.userChanged(u2);
+        BOOST_CHECK_EQUAL(b.allyTeamCounts().size(), 1);
+        BOOST_CHECK_EQUAL(b.allyTeamCounts().at(0), 2);
+
+        // add bot to ally team 1
+        std::stringstream ssBot("bot player1 0 255 AI");
+        Bot bot(ssBot);
+        ubs = UserBattleStatus();
+        ubs.spectator(false);
+        ubs.allyTeam(1);
+        bot.battleStatus(ubs);
+        b.botAdded(bot);
+        BOOST_CHECK_EQUAL(b.botCount(), 1);
+        BOOST_CHECK_EQUAL(b.allyTeamCounts().at(1), 1);
+
+        b.left(u1);
+        BOOST_CHECK_EQUAL(b.playerCount(), 1);
+        BOOST_CHECK_EQUAL(b.allyTeamCounts().at(0), 1);
+
+        b.removeBots();
+        BOOST_CHECK_EQUAL(b.botCount(), 0);
+        BOOST_CHECK_EQUAL(b.allyTeamCounts().size(), 1);
+
+        Battle::BattleUsers const leftUsers = b.close();
+        BOOST_CHECK_EQUAL(leftUsers.size(), 2);
+        BOOST_CHECK_EQUAL(b.userCount(), 0);
+        BOOST_CHECK_EQUAL(b.playerCount(), 0);
+        BOOST_CHECK(b.allyTeamCounts().empty());
+    }
+
     // test exception is thrown on incomplete msg
     {
         std::stringstream ss("id not int");
@@ -373,6 +506,71 @@ BOOST_AUTO_TEST_CASE(testBattle)
     }
 }
 
+BOOST_AUTO_TEST_CASE(testBattleFilter)
+{
+    std::stringstream ssOpened(
+            "8235 0 0 Founder "
+            "94.23.170.70 8463 32 "
+            "1 0 -112462944 "
+            "spring\t"
+            "104.0\t"
+            "Comet Catcher Redux\t"
+            "Battle title\t"
+            "Zero-K v1.4");
+    Battle b(ssOpened);
+
+    std::stringstream ss1("player1 SE 0");
+    User u1(ss1);
+    std::stringstream ss2("player2 SE 0");
+    User u2(ss2);
+    b.joined(u1);
+
+    // default filter passes all
+    BOOST_CHECK(BattleFilter().passes(b));
+
+    BattleFilterSettings settings;
+
+    // comma separated case-insensitive substrings, empty patterns ignored
+    settings.game_ = " nota , zero-k ";
+    BOOST_CHECK(BattleFilter(settings).passes(b));
+    settings.game_ = "nota";
+    BOOST_CHECK(!BattleFilter(settings).passes(b));
+    settings.game_ = "nota,";
+    BOOST_CHECK(!BattleFilter(settings).passes(b));
+    settings.game_ = " , ";
+    BOOST_CHECK(BattleFilter(settings).passes(b));
+    settings.game_ = "";
+
+    settings.map_ = "COMET";
+    settings.engine_ = "104";
+    settings.host_ = "found";
+    BOOST_CHECK(BattleFilter(settings).passes(b));
+    settings.host_ = "someone";
+    BOOST_CHECK(!BattleFilter(settings).passes(b));
+    settings.host_ = "";
+
+    // player range
+    settings.minPlayers_ = 1;
+    BOOST_CHECK(BattleFilter(settings).passes(b));
+    settings.minPlayers_ = 2;
+    BOOST_CHECK(!BattleFilter(settings).passes(b));
+    settings.minPlayers_ = 0;
+    settings.maxPlayers_ = 1;
+    BOOST_CHECK(BattleFilter(settings).passes(b));
+    b.joined(u2);
+    BOOST_CHECK(!BattleFilter(settings).passes(b));
+    settings.maxPlayers_ = 0;
+
+    // status
+    settings.hidePassworded_ = true;
+    BOOST_CHECK(!BattleFilter(settings).passes(b));
+    settings.hidePassworded_ = false;
+    settings.hideRunning_ = true;
+    BOOST_CHECK(BattleFilter(settings).passes(b));
+    b.running(true);
+    BOOST_CHECK(!BattleFilter(settings).passes(b));
+}
+
 BOOST_AUTO_TEST_CASE(testScript)
 {
     Script script;
@@ -544,6 +742,148 @@ BOOST_AUTO_TEST_CASE(testLog)
     }
 }
 
+static
+void logAsyncThread(int id)
+{
+    for (int i=0; i<100; ++i)
+    {
+        LOG(DEBUG) << "test_async_thread_" << id << "_" << i;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testLogAsync)
+{
+    // 10 threads queue 100 lines each, all must be in the log file after disabling async
+
+    Log::async(true);
+    BOOST_CHECK(Log::async());
+
+    int const cnt = 10;
+    std::vector< std::unique_ptr<std::thread>> threads(cnt);
+
+    for (int i=0; i<cnt; ++i)
+    {
+        threads[i].reset( new std::thread(std::bind(logAsyncThread, i)) );
+    }
+
+    for (int i=0; i<cnt; ++i)
+    {
+        threads[i]->join();
+    }
+
+    Log::async(false);
+    BOOST_CHECK(!Log::async());
+
+    std::ifstream ifs(Log::logFile());
+    std::string line;
+    int lines = 0;
+    while (std::getline(ifs, line))
+    {
+        if (line.find("test_async_thread_") != std::string::npos) ++lines;
+    }
+    BOOST_CHECK_EQUAL(lines, cnt*100);
+}
+
+BOOST_AUTO_TEST_CASE(testLogArgs)
+{
+    // captured arguments are rendered like std::ostream does
+    char const * null = 0;
+    Log(Log::Info, __FILE__, __LINE__).get() << "test_log_args " << 42 << ' ' << -7L << ' ' << 3.5 << ' ' << 1e20 << ' '
+        << true << ' ' << std::string("str") << ' ' << static_cast<uint8_t>('x') << ' ' << 18446744073709551615ULL << ' '
+        << null << ' ' << boost::filesystem::path("a/b");
+
+    std::ifstream ifs(Log::logFile());
+    std::string line;
+    std::string found;
+    while (std::getline(ifs, line))
+    {
+        if (line.find("test_log_args") != std::string::npos) found = line;
+    }
+    BOOST_CHECK(found.find("] test_log_args 42 -7 3.5 1e+20 1 str x 18446744073709551615 (null) \"a/b\"") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(testLogCrash)
+{
+    // a child logs asynchronously and crashes, its last record must be in the log file
+
+    auto lastRecordWritten = [](std::function<void()> crash, std::string const & text, int sig)
+    {
+        std::cout.flush();
+        pid_t const pid = fork();
+        if (pid == 0)
+        {
+            Log::installCrashHandlers();
+            Log::async(true);
+            LOG(INFO) << text;
+            crash();
+            _exit(0);
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        BOOST_CHECK(WIFSIGNALED(status) && WTERMSIG(status) == sig);
+
+        std::ifstream ifs(Log::logFile());
+        std::string line;
+        bool found = false;
+        while (std::getline(ifs, line))
+        {
+            if (line.find(text) != std::string::npos) found = true;
+        }
+        return found;
+    };
+
+    BOOST_CHECK(lastRecordWritten([]() { std::abort(); }, "test_crash_abort", SIGABRT));
+    BOOST_CHECK(lastRecordWritten([]() { std::terminate(); }, "test_crash_terminate", SIGABRT));
+    BOOST_CHECK(lastRecordWritten([]() { std::raise(SIGSEGV); }, "test_crash_segv", SIGSEGV));
+    std::remove((Log::logFile() + ".fatal").c_str());
+}
+
+BOOST_AUTO_TEST_CASE(testLogModules)
+{
+    // the module of this file is "Test"
+    BOOST_CHECK_EQUAL(logModule_.minSeverity(), Log::minSeverity());
+
+    Log::moduleSeverities(" Model=debug, Test = Error ");
+    BOOST_CHECK_EQUAL(logModule_.minSeverity(), Log::Error);
+
+    BOOST_CHECK_THROW(Log::moduleSeverities("Test"), std::invalid_argument);
+    BOOST_CHECK_THROW(Log::moduleSeverities("Test=verbose"), std::invalid_argument);
+    BOOST_CHECK_EQUAL(logModule_.minSeverity(), Log::Error); // unchanged by bad specs
+
+    Log::moduleSeverities("");
+    BOOST_CHECK_EQUAL(logModule_.minSeverity(), Log::minSeverity());
+
+    LogRateLimit none;
+    BOOST_CHECK(!none.allow(0));
+
+    // two per second, dropped records are counted in the next allowed one
+    LogRateLimit limit;
+    BOOST_CHECK(limit.allow(2, 100));
+    BOOST_CHECK_EQUAL(LogRateLimit::lastSuppressed(), 0);
+    BOOST_CHECK(limit.allow(2, 100));
+    BOOST_CHECK(!limit.allow(2, 100));
+    BOOST_CHECK(!limit.allow(2, 100));
+    BOOST_CHECK(!limit.allow(2, 100));
+    BOOST_CHECK(limit.allow(2, 101));
+    BOOST_CHECK_EQUAL(LogRateLimit::lastSuppressed(), 3);
+    BOOST_CHECK(limit.allow(2, 101));
+    BOOST_CHECK_EQUAL(LogRateLimit::lastSuppressed(), 0);
+    BOOST_CHECK(!limit.allow(2, 101));
+    BOOST_CHECK(limit.allow(2, 105));
+    BOOST_CHECK_EQUAL(LogRateLimit::lastSuppressed(), 1);
+
+    Log(Log::Info, __FILE__, __LINE__, 4).get() << "test_rate_limited";
+    std::ifstream ifs(Log::logFile());
+    std::string line;
+    std::string found;
+    while (std::getline(ifs, line))
+    {
+        if (line.find("test_rate_limited") != std::string::npos) found = line;
+    }
+    BOOST_CHECK(found.find("test_rate_limited (4 suppressed)") != std::string::npos);
+}
+
 BOOST_AUTO_TEST_CASE(testTextFunctions)
 {
     typedef std::vector<std::string> StringVector;
@@ -807,3 +1147,356 @@ BOOST_AUTO_TEST_CASE(test_splitAtLast)
         BOOST_CHECK(pair.second == "");
     }
 }
+
+BOOST_AUTO_TEST_CASE(testImageScale)
+{
+    // box filter averages whole pixels for integer ratios
+    {
+        uint8_t const src[] = { 10, 20, 30, 40,
+                                50, 60, 70, 80 };
+        uint8_t dst[2];
+        scaleImage(src, 4, 2, dst, 2, 1, 1, ImageFilterBox, ImageScaleScalar);
+        BOOST_CHECK_EQUAL(dst[0], 35);
+        BOOST_CHECK_EQUAL(dst[1], 55);
+    }
+
+    // constant images stay constant
+    {
+        std::vector<uint8_t> src(300*200*3, 77);
+        std::vector<uint8_t> dst(128*85*3);
+        scaleImage(src.data(), 300, 200, dst.data(), 128, 85, 3, ImageFilterLanczos, ImageScaleScalar);
+        BOOST_CHECK(std::count(dst.begin(), dst.end(), 77) == static_cast<int>(dst.size()));
+    }
+
+    // SIMD paths give the same result as the scalar path
+    std::srand(1);
+    int const sizes[][4] = { {1024, 1024, 128, 128}, {1024, 1024, 128, 77}, {513, 257, 128, 64}, {37, 19, 5, 3} };
+    for (auto const & size : sizes)
+    {
+        for (int d : {1, 3})
+        {
+            std::vector<uint8_t> src(size[0]*size[1]*d);
+            for (uint8_t & v : src) v = std::rand() % 256;
+
+            for (ImageFilter filter : {ImageFilterBox, ImageFilterLanczos})
+            {
+                std::vector<uint8_t> expected(size[2]*size[3]*d);
+                scaleImage(src.data(), size[0], size[1], expected.data(), size[2], size[3], d, filter, ImageScaleScalar);
+
+                for (ImageScalePath path : {ImageScaleSse2, ImageScaleAvx2})
+                {
+                    if (!imageScalePathSupported(path)) continue;
+                    std::vector<uint8_t> dst(expected.size());
+                    scaleImage(src.data(), size[0], size[1], dst.data(), size[2], size[3], d, filter, path);
+                    BOOST_CHECK(dst == expected);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testPixelConvert)
+{
+    // all 565 values, compared with the plain formula
+    std::vector<uint16_t> src(65536);
+    for (int i = 0; i < 65536; ++i) src[i] = i;
+
+    std::vector<uint8_t> expected(src.size()*3);
+    for (int i = 0; i < 65536; ++i)
+    {
+        int const r5 = i >> 11, g6 = (i >> 5) & 0x3f, b5 = i & 0x1f;
+        expected[i*3+0] = (r5 << 3) | (r5 >> 2);
+        expected[i*3+1] = (g6 << 2) | (g6 >> 4);
+        expected[i*3+2] = (b5 << 3) | (b5 >> 2);
+    }
+
+    for (PixelConvertPath path : {PixelConvertScalar, PixelConvertSse2, PixelConvertAvx2})
+    {
+        if (!pixelConvertPathSupported(path)) continue;
+        std::vector<uint8_t> dst(expected.size());
+        rgb565ToRgb888(src.data(), dst.data(), src.size(), path);
+        BOOST_CHECK(dst == expected);
+    }
+
+    // odd counts must not write past the end
+    std::srand(1);
+    std::vector<uint8_t> grey(1000);
+    for (uint8_t & v : grey) v = std::rand() % 256;
+
+    for (std::size_t count : {0, 1, 7, 15, 17, 33, 999})
+    {
+        std::vector<uint8_t> expected565(count*3 + 1, 0xaa);
+        rgb565ToRgb888(src.data() + 12345, expected565.data(), count, PixelConvertScalar);
+        std::vector<uint8_t> expectedGrey(count*3 + 1, 0xaa);
+        greyToRgb888(grey.data(), expectedGrey.data(), count, 0, 0xff, 0, PixelConvertScalar);
+        BOOST_CHECK_EQUAL(expectedGrey.back(), 0xaa);
+        if (count > 0) BOOST_CHECK_EQUAL(expectedGrey[1], grey[0]);
+
+        for (PixelConvertPath path : {PixelConvertSse2, PixelConvertAvx2})
+        {
+            if (!pixelConvertPathSupported(path)) continue;
+            std::vector<uint8_t> dst(count*3 + 1, 0xaa);
+            rgb565ToRgb888(src.data() + 12345, dst.data(), count, path);
+            BOOST_CHECK(dst == expected565);
+            dst.assign(count*3 + 1, 0xaa);
+            greyToRgb888(grey.data(), dst.data(), count, 0, 0xff, 0, path);
+            BOOST_CHECK(dst == expectedGrey);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testThumbnailAtlas)
+{
+    std::string const path = "thumbnails_test.bin";
+    std::remove(path.c_str());
+
+    std::vector<uint8_t> rgb(128*96*3);
+    for (std::size_t i = 0; i < rgb.size(); ++i) rgb[i] = i % 251;
+    std::vector<uint8_t> grey(64*128, 7);
+    std::vector<uint8_t> grey2(64*128, 9);
+
+    auto equal = [](ThumbnailAtlas::Image const & image, std::vector<uint8_t> const & data, int w, int h, int d)
+    {
+        return image.w_ == w && image.h_ == h && image.d_ == d && std::equal(data.begin(), data.end(), image.data_);
+    };
+
+    {
+        ThumbnailAtlas atlas(path);
+        BOOST_CHECK_EQUAL(atlas.size(), 0);
+        atlas.add("a_1_minimap_128", rgb.data(), 128, 96, 3);
+        atlas.add("a_1_height_128", grey.data(), 64, 128, 1);
+
+        ThumbnailAtlas::Image image;
+        BOOST_REQUIRE(atlas.get("a_1_minimap_128", image));
+        BOOST_CHECK(equal(image, rgb, 128, 96, 3));
+        BOOST_CHECK(!atlas.has("b_2_minimap_128"));
+        BOOST_CHECK(!atlas.get("b_2_minimap_128", image));
+
+        // the file is locked, a second atlas keeps new images in memory
+        ThumbnailAtlas other(path);
+        BOOST_CHECK_EQUAL(other.size(), 2);
+        other.add("b_2_minimap_128", rgb.data(), 128, 96, 3);
+        BOOST_REQUIRE(other.get("b_2_minimap_128", image));
+        BOOST_CHECK(equal(image, rgb, 128, 96, 3));
+    }
+
+    {
+        ThumbnailAtlas atlas(path);
+        BOOST_CHECK_EQUAL(atlas.size(), 2);
+        atlas.add("a_1_height_128", grey2.data(), 64, 128, 1);
+    }
+
+    // a damaged end is dropped
+    {
+        std::ofstream ofs(path, std::ios::app | std::ios::binary);
+        ofs << "garbage";
+    }
+
+    {
+        ThumbnailAtlas atlas(path);
+        BOOST_CHECK_EQUAL(atlas.size(), 2);
+        ThumbnailAtlas::Image image;
+        BOOST_REQUIRE(atlas.get("a_1_height_128", image));
+        BOOST_CHECK(equal(image, grey2, 64, 128, 1));
+        atlas.add("c_3_metal_128", grey.data(), 128, 64, 1);
+    }
+
+    {
+        ThumbnailAtlas atlas(path);
+        BOOST_CHECK_EQUAL(atlas.size(), 3);
+        ThumbnailAtlas::Image image;
+        BOOST_REQUIRE(atlas.get("c_3_metal_128", image));
+        BOOST_CHECK(equal(image, grey, 128, 64, 1));
+        BOOST_REQUIRE(atlas.get("a_1_minimap_128", image));
+        BOOST_CHECK(equal(image, rgb, 128, 96, 3));
+    }
+
+    // removed images stay removed, images already returned stay valid
+    {
+        ThumbnailAtlas atlas(path);
+        ThumbnailAtlas::Image image;
+        BOOST_REQUIRE(atlas.get("c_3_metal_128", image));
+        atlas.remove("c_3_metal_128");
+        BOOST_CHECK(!atlas.has("c_3_metal_128"));
+        BOOST_CHECK(equal(image, grey, 128, 64, 1));
+        BOOST_CHECK_EQUAL(atlas.keys().size(), 2);
+    }
+
+    {
+        ThumbnailAtlas atlas(path);
+        BOOST_CHECK_EQUAL(atlas.size(), 2);
+        BOOST_CHECK(!atlas.has("c_3_metal_128"));
+    }
+
+    // damaged pixels are found by the checksum
+    {
+        std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+        std::string const content((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+        std::string const key = "a_1_height_128";
+        std::size_t const pos = content.rfind(key);
+        BOOST_REQUIRE(pos != std::string::npos);
+        fs.seekp(pos + key.size() + 100);
+        fs.put(0);
+    }
+
+    {
+        ThumbnailAtlas atlas(path);
+        BOOST_CHECK(atlas.has("a_1_height_128"));
+        ThumbnailAtlas::Image image;
+        BOOST_CHECK(!atlas.get("a_1_height_128", image));
+        BOOST_CHECK(!atlas.has("a_1_height_128"));
+        atlas.add("a_1_height_128", grey2.data(), 64, 128, 1);
+        BOOST_REQUIRE(atlas.get("a_1_height_128", image));
+        BOOST_CHECK(equal(image, grey2, 64, 128, 1));
+    }
+
+    // many replaced images are compacted, an atlas opened before keeps its images
+    std::unique_ptr<ThumbnailAtlas> reader;
+    ThumbnailAtlas::Image readerImage;
+    {
+        ThumbnailAtlas atlas(path);
+        for (int i = 0; i < 40; ++i)
+        {
+            atlas.add("a_1_minimap_128", rgb.data(), 128, 96, 3);
+        }
+        reader.reset(new ThumbnailAtlas(path));
+        BOOST_REQUIRE(reader->get("a_1_minimap_128", readerImage));
+    }
+    BOOST_CHECK(boost::filesystem::file_size(path) > 40*rgb.size());
+
+    {
+        ThumbnailAtlas atlas(path);
+        BOOST_CHECK(equal(readerImage, rgb, 128, 96, 3));
+        reader.reset();
+        BOOST_CHECK(boost::filesystem::file_size(path) < 2*rgb.size());
+        BOOST_CHECK_EQUAL(atlas.size(), 2);
+        ThumbnailAtlas::Image image;
+        BOOST_REQUIRE(atlas.get("a_1_minimap_128", image));
+        BOOST_CHECK(equal(image, rgb, 128, 96, 3));
+        BOOST_REQUIRE(atlas.get("a_1_height_128", image));
+        BOOST_CHECK(equal(image, grey2, 64, 128, 1));
+    }
+
+    // many images added after opening do not need a mapping each
+    {
+        ThumbnailAtlas atlas(path);
+        for (int i = 0; i < 3000; ++i)
+        {
+            std::string const key = "m_" + std::to_string(i) + "_minimap_128";
+            atlas.add(key, grey.data(), 16, 16, 3);
+            ThumbnailAtlas::Image image;
+            BOOST_REQUIRE(atlas.get(key, image));
+            BOOST_CHECK_EQUAL(image.data_[0], 7);
+        }
+
+        std::ifstream maps("/proc/self/maps");
+        std::string line;
+        int mappings = 0;
+        while (std::getline(maps, line))
+        {
+            if (line.find(path) != std::string::npos) ++mappings;
+        }
+        BOOST_CHECK(mappings <= 2);
+    }
+
+    std::remove(path.c_str());
+    std::remove((path + ".lock").c_str());
+}
+
+BOOST_AUTO_TEST_CASE(testMapInfoIndex)
+{
+    std::string const path = "mapinfo_test.bin";
+    std::remove(path.c_str());
+
+    MapInfo mi;
+    mi.name_ = "Small Supreme Battlefield";
+    mi.fileName_ = "ssb.smf";
+    mi.description_ = std::string("with\0null", 9);
+    mi.author_ = "someone";
+    mi.checksum_ = 0xdeadbeef;
+    mi.width_ = 8*512;
+    mi.height_ = 6*512;
+    mi.tidalStrength_ = 20;
+    mi.windMin_ = -1;
+    mi.windMax_ = 25;
+    mi.gravity_ = 130;
+
+    {
+        MapInfoIndex index(path);
+        BOOST_CHECK_EQUAL(index.size(), 0);
+        BOOST_CHECK(index.find("a_1") == 0);
+        index.add("a_1", mi);
+        index.add("b_2", MapInfo());
+        mi.gravity_ = 100;
+        index.add("a_1", mi); // replaces
+        BOOST_CHECK_EQUAL(index.size(), 2);
+
+        // the file is locked, a second index keeps new infos in memory
+        MapInfoIndex other(path);
+        BOOST_CHECK_EQUAL(other.size(), 2);
+        other.add("x_9", mi);
+        BOOST_CHECK(other.find("x_9") != 0);
+        BOOST_CHECK_THROW(other.compact(), std::runtime_error);
+    }
+
+    {
+        MapInfoIndex index(path);
+        BOOST_CHECK_EQUAL(index.size(), 2);
+        BOOST_CHECK(index.find("x_9") == 0);
+        BOOST_REQUIRE(index.find("a_1") != 0);
+        MapInfo const & res = *index.find("a_1");
+        BOOST_CHECK(res == mi);
+        BOOST_CHECK_EQUAL(res.checksum_, mi.checksum_);
+        BOOST_CHECK_EQUAL(res.gravity_, 100);
+        BOOST_CHECK_EQUAL(res.windMin_, -1);
+    }
+
+    // a damaged end is dropped
+    {
+        std::ofstream ofs(path, std::ios::app | std::ios::binary);
+        ofs << "garbage!garbage";
+    }
+
+    {
+        MapInfoIndex index(path);
+        BOOST_CHECK_EQUAL(index.size(), 2);
+        index.add("c_3", mi);
+    }
+
+    // many replaced records are compacted
+    for (int i = 0; i < 100; ++i)
+    {
+        MapInfoIndex index(path);
+        BOOST_CHECK_EQUAL(index.size(), 3);
+        index.add("c_3", mi);
+    }
+    BOOST_CHECK(boost::filesystem::file_size(path) < 64*200);
+
+    // also while running
+    {
+        MapInfoIndex index(path);
+        for (int i = 0; i < 1000; ++i)
+        {
+            index.add("c_3", mi);
+        }
+        BOOST_CHECK(boost::filesystem::file_size(path) < 64*200);
+    }
+    {
+        MapInfoIndex index(path);
+        BOOST_CHECK_EQUAL(index.size(), 3);
+    }
+
+    // unknown format
+    {
+        std::ofstream ofs(path, std::ios::trunc | std::ios::binary);
+        ofs << "MapInfo_1";
+    }
+
+    {
+        MapInfoIndex index(path);
+        BOOST_CHECK_EQUAL(index.size(), 0);
+    }
+
+    std::remove(path.c_str());
+    std::remove((path + ".lock").c_str());
+}